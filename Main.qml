@@ -48,6 +48,24 @@ ApplicationWindow {
             }
         }
 
+        RowLayout {
+            Layout.fillWidth: true
+            Label {
+                text: qsTr("Profile")
+                color: "#ffffff"
+            }
+            // JSON-профиль плана калибровки; применяется при следующем запуске
+            TextField {
+                Layout.fillWidth: true
+                implicitHeight: 40
+                font.pixelSize: 16
+                text: controller.profilePath
+                enabled: !controller.running
+                selectByMouse: true
+                onEditingFinished: controller.profilePath = text
+            }
+        }
+
         Button {
             Layout.alignment: Qt.AlignHCenter
             text: controller.running ? qsTr("Stop") : qsTr("Start")
@@ -91,6 +109,12 @@ ApplicationWindow {
                         color: "#ffffff"
                         font.bold: true
                     }
+                    Label {
+                        text: qsTr("%1 … %2").arg(Number(controller.flowMin).toFixed(2))
+                                             .arg(Number(controller.flowMax).toFixed(2))
+                        color: "#bbbbbb"
+                        font.pixelSize: 14
+                    }
                 }
 
                 ColumnLayout {
@@ -104,6 +128,26 @@ ApplicationWindow {
                     }
                 }
 
+                ColumnLayout {
+                    spacing: 4
+                    Label { text: qsTr("PRES"); color: "#bbbbbb" }
+                    Label {
+                        Layout.minimumWidth: 80
+                        text: Number(controller.pressure).toFixed(1)
+                        color: "#ffffff"
+                    }
+                }
+
+                ColumnLayout {
+                    spacing: 4
+                    Label { text: qsTr("TEMP"); color: "#bbbbbb" }
+                    Label {
+                        Layout.minimumWidth: 80
+                        text: Number(controller.temperature).toFixed(1)
+                        color: "#ffffff"
+                    }
+                }
+
                 Item { Layout.fillWidth: true }
 
                 ColumnLayout {
@@ -130,7 +174,7 @@ ApplicationWindow {
 
         Frame {
             Layout.fillWidth: true
-            Layout.preferredHeight: 100
+            Layout.preferredHeight: 130
             background: Rectangle {
                 color: "#282c34"
                 radius: 8
@@ -171,6 +215,17 @@ ApplicationWindow {
 
                     Item { Layout.fillWidth: true }
                 }
+
+                Label {
+                    visible: !isNaN(controller.slopeLow)
+                    text: qsTr("95% CI: slope %1 … %2, offset %3 … %4%5")
+                        .arg(Number(controller.slopeLow).toFixed(2))
+                        .arg(Number(controller.slopeHigh).toFixed(2))
+                        .arg(Number(controller.offsetLow).toFixed(0))
+                        .arg(Number(controller.offsetHigh).toFixed(0))
+                        .arg(controller.fitAccepted ? "" : qsTr(" — rejected, re-run"))
+                    color: controller.fitAccepted ? "#bbbbbb" : "#ff6b6b"
+                }
             }
         }
 
@@ -0,0 +1,218 @@
+/**
+ * @file Bootstrap.h
+ * @brief Доверительные интервалы калибровочной прямой методом бутстрепа.
+ */
+
+#pragma once
+
+#include <QRandomGenerator>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * @brief Бутстреп прямой PWM(flow) по установившимся измерениям уставок.
+ *
+ * Повторные выборки стратифицированы по уставкам: внутри каждой уставки
+ * измерения выбираются с возвращением в прежнем количестве, поэтому в
+ * каждой выборке есть все уставки и прямая всегда определена. Выборка
+ * задаётся весами (сколько раз взято каждое измерение), а суммы МНК
+ * считаются скалярными произведениями весов на заранее вычисленные
+ * колонки — непрерывные массивы без ветвлений, которые компилятор
+ * векторизует. Повторные выборки делятся между потоками глобального
+ * пула Qt, у каждой задачи свой генератор со своим зерном, так что
+ * результат воспроизводим и не зависит от числа потоков.
+ *
+ * Точечная оценка прямой считается тем же МНК по тем же измерениям
+ * (выборка с единичными весами), поэтому интервалы относятся именно к
+ * ней. Интервалы не строятся, если в какой-то уставке меньше
+ * @ref MIN_GROUP_SAMPLES измерений: выборки с возвращением из одного-двух
+ * значений почти не меняются и дают ложно узкий интервал.
+ *
+ * Функция блокирует вызывающий поток до конца расчёта; из потока
+ * интерфейса её запускают через @c QtConcurrent::run() и ждут
+ * @ref Coro::resultOf().
+ */
+namespace Bootstrap {
+    /// Установившееся измерение: расход и PWM, при котором он получен.
+    struct Sample {
+        double flow;
+        double pwm;
+    };
+
+    /// Доверительный интервал (NAN — не вычислен).
+    struct Interval {
+        double low = NAN;
+        double high = NAN;
+
+        double width() const { return high - low; }
+    };
+
+    /// Прямая PWM = offset + 800 - slope * flow, как в @ref Insufflator::approximate().
+    struct Line {
+        double slope = NAN;  ///< Наклон (PWM на 1 л/мин со знаком минус).
+        double offset = NAN; ///< Смещение.
+        double rms = NAN;    ///< СКО измерений от прямой по расходу, л/мин.
+
+        /// Прямая определена.
+        bool valid() const { return !std::isnan(slope); }
+    };
+
+    /// Оценка прямой и интервалы её параметров.
+    struct LineFit {
+        Line estimate;       ///< Оценка по всем измерениям (не определена, если PWM не зависит от расхода).
+        bool ok = false;     ///< Интервалы вычислены.
+        Interval slope;      ///< Наклон (PWM на 1 л/мин со знаком минус).
+        Interval offset;     ///< Смещение.
+        int resamples = 0;   ///< Повторных выборок, давших прямую.
+    };
+
+    /// Повторных выборок на одну задачу пула.
+    constexpr int RESAMPLES_PER_TASK = 256;
+
+    /// Минимум установившихся измерений в каждой уставке для интервалов.
+    constexpr int MIN_GROUP_SAMPLES = 5;
+
+    /// Σ w[i] * a[i] четырьмя независимыми накопителями.
+    inline double dot(const double *w, const double *a, int n) {
+        double acc[4] = {0, 0, 0, 0};
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            for (int k = 0; k < 4; ++k)
+                acc[k] += w[i + k] * a[i + k];
+        for (; i < n; ++i)
+            acc[0] += w[i] * a[i];
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+    /// Квантиль отсортированной выборки (линейная интерполяция).
+    inline double quantile(const std::vector<double> &sorted, double q) {
+        const double pos = q * (sorted.size() - 1);
+        const size_t i = static_cast<size_t>(pos);
+        const double frac = pos - i;
+        return i + 1 < sorted.size() ? sorted[i] * (1 - frac) + sorted[i + 1] * frac : sorted[i];
+    }
+
+    /**
+     * @brief Оценка калибровочной прямой и процентильные интервалы её наклона и смещения.
+     * @param groups     Установившиеся измерения, по группе на уставку (нужно не меньше двух;
+     *                   для интервалов — не меньше @ref MIN_GROUP_SAMPLES в каждой).
+     * @param resamples  Количество повторных выборок.
+     * @param confidence Доверительная вероятность.
+     * @param seed       Зерно генераторов (задача i использует seed + i).
+     */
+    inline LineFit fitLine(const QVector<QVector<Sample>> &groups, int resamples,
+                           double confidence = 0.95, quint32 seed = 1) {
+        LineFit fit;
+
+        // колонки с центрированными данными: x, y, x*x, x*y
+        std::vector<double> x, y, xx, xy;
+        QVector<int> groupStart, groupSize;
+        double meanFlow = 0, meanPwm = 0;
+        int n = 0;
+        for (const QVector<Sample> &g: groups) {
+            for (const Sample &s: g) {
+                meanFlow += s.flow;
+                meanPwm += s.pwm;
+            }
+            n += g.size();
+        }
+        int nonEmpty = 0;
+        bool enough = true;
+        for (const QVector<Sample> &g: groups) {
+            nonEmpty += !g.isEmpty();
+            enough = enough && g.size() >= MIN_GROUP_SAMPLES;
+        }
+        if (nonEmpty < 2)
+            return fit;
+        meanFlow /= n;
+        meanPwm /= n;
+
+        for (const QVector<Sample> &g: groups) {
+            if (g.isEmpty())
+                continue;
+            groupStart.append(static_cast<int>(x.size()));
+            groupSize.append(g.size());
+            for (const Sample &s: g) {
+                const double cx = s.flow - meanFlow;
+                const double cy = s.pwm - meanPwm;
+                x.push_back(cx);
+                y.push_back(cy);
+                xx.push_back(cx * cx);
+                xy.push_back(cx * cy);
+            }
+        }
+
+        // оценка по всем измерениям: суммы центрированных колонок с единичными весами
+        const std::vector<double> ones(x.size(), 1.0);
+        const double sxx = dot(ones.data(), xx.data(), n);
+        const double sxy = dot(ones.data(), xy.data(), n);
+        if (sxx <= 1e-12 || sxy == 0)
+            return fit;
+        fit.estimate.slope = -sxy / sxx;
+        fit.estimate.offset = meanPwm + meanFlow * fit.estimate.slope - 800;
+        double sse = 0;
+        for (int i = 0; i < n; ++i) {
+            const double e = x[size_t(i)] + y[size_t(i)] / fit.estimate.slope;
+            sse += e * e;
+        }
+        fit.estimate.rms = std::sqrt(sse / n);
+
+        if (!enough || resamples < 1)
+            return fit;
+
+        struct Task {
+            int first;
+            int count;
+        };
+        QVector<Task> tasks;
+        for (int first = 0; first < resamples; first += RESAMPLES_PER_TASK)
+            tasks.append(Task{first, qMin(RESAMPLES_PER_TASK, resamples - first)});
+
+        std::vector<double> slopes(size_t(resamples), NAN);
+        std::vector<double> offsets(size_t(resamples), NAN);
+
+        QtConcurrent::blockingMap(tasks, [&](const Task &task) {
+            QRandomGenerator rng(seed + static_cast<quint32>(task.first / RESAMPLES_PER_TASK));
+            std::vector<double> w(x.size());
+            for (int r = task.first; r < task.first + task.count; ++r) {
+                std::fill(w.begin(), w.end(), 0.0);
+                for (int g = 0; g < groupStart.size(); ++g)
+                    for (int k = 0; k < groupSize[g]; ++k)
+                        w[size_t(groupStart[g]) + rng.bounded(static_cast<quint32>(groupSize[g]))] += 1;
+
+                const double sw = n;
+                const double sx = dot(w.data(), x.data(), n);
+                const double sy = dot(w.data(), y.data(), n);
+                const double sxx = dot(w.data(), xx.data(), n) - sx * sx / sw;
+                const double sxy = dot(w.data(), xy.data(), n) - sx * sy / sw;
+                if (sxx <= 1e-12)
+                    continue;
+
+                const double slope = -sxy / sxx;
+                slopes[size_t(r)] = slope;
+                offsets[size_t(r)] = meanPwm + sy / sw + (meanFlow + sx / sw) * slope - 800;
+            }
+        });
+
+        auto valid = [](std::vector<double> &v) {
+            v.erase(std::remove_if(v.begin(), v.end(), [](double d) { return std::isnan(d); }), v.end());
+            std::sort(v.begin(), v.end());
+        };
+        valid(slopes);
+        valid(offsets);
+        if (slopes.size() < 2)
+            return fit;
+
+        const double tail = (1 - confidence) / 2;
+        fit.ok = true;
+        fit.resamples = static_cast<int>(slopes.size());
+        fit.slope = Interval{quantile(slopes, tail), quantile(slopes, 1 - tail)};
+        fit.offset = Interval{quantile(offsets, tail), quantile(offsets, 1 - tail)};
+        return fit;
+    }
+}
@@ -0,0 +1,163 @@
+/**
+ * @file CalibrationPlan.h
+ * @brief Настраиваемый план калибровки: список уставок расхода и критерии их достижения.
+ */
+
+#pragma once
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVector>
+
+#include "Fixed.h"
+
+/**
+ * @brief Упорядоченный список уставок калибровки, загружаемый из профиля.
+ *
+ * Профиль — JSON-файл вида
+ * @code
+ * {
+ *   "name": "CO2 valve, 5 points",
+ *   "minPoints": 3,
+ *   "fitTolerance": 0.15,
+ *   "maxSlopeCI": 1.5,
+ *   "maxOffsetCI": 40,
+ *   "bootstrapResamples": 4000,
+ *   "setpoints": [
+ *     { "flow": 2.0,  "tolerance": 0.3, "settlePulses": 1, "timeoutMs": 60000 },
+ *     { "flow": 20.0, "tolerance": 0.3 }
+ *   ]
+ * }
+ * @endcode
+ * Уставки обходятся в порядке профиля: каждая начинается с закрытого
+ * клапана, поэтому порядок на ход клапана не влияет.
+ * Опущенные поля уставки берут значения по умолчанию из @ref Setpoint.
+ * Если после @c minPoints точек среднеквадратичное отклонение точек от
+ * прямой не больше @c fitTolerance (л/мин), оставшиеся уставки пропускаются.
+ * Через две точки прямая проходит без отклонения, поэтому при заданном
+ * @c fitTolerance точек нужно не меньше @ref MIN_FIT_POINTS (по умолчанию
+ * столько и берётся).
+ * Калибровка отклоняется, если ширина 95% доверительного интервала наклона
+ * или смещения (см. @ref Bootstrap::fitLine()) больше @c maxSlopeCI /
+ * @c maxOffsetCI.
+ */
+class CalibrationPlan {
+public:
+    /**
+     * @brief Одна уставка плана.
+     */
+    struct Setpoint {
+        Units::Flow flow;                                   ///< Целевой расход.
+        Units::Flow tolerance = Units::Flow::fromRaw(30);   ///< Допустимая ошибка расхода (0.3 л/мин).
+        int settlePulses = 1;                               ///< Сколько импульсов подряд ошибка должна быть в допуске.
+        int timeoutMs = 60000;                              ///< Предельное время на уставку (мс).
+    };
+
+    /// Минимум точек, по отклонению которых от прямой можно судить о её качестве.
+    static constexpr int MIN_FIT_POINTS = 3;
+
+    QString name = QStringLiteral("default"); ///< Имя профиля для лога.
+    QVector<Setpoint> setpoints;              ///< Уставки в порядке обхода.
+    int minPoints = 2;                        ///< Минимум точек до досрочного завершения.
+    double fitTolerance = 0.0;                ///< Порог досрочного завершения (0 — выключено).
+    double maxSlopeCI = 0.0;                  ///< Предельная ширина интервала наклона (0 — не проверять).
+    double maxOffsetCI = 0.0;                 ///< Предельная ширина интервала смещения (0 — не проверять).
+    int bootstrapResamples = 4000;            ///< Повторных выборок бутстрепа.
+
+    /// План по умолчанию: 2 и 20 л/мин, как в исходной двухточечной калибровке.
+    static CalibrationPlan defaultPlan() {
+        CalibrationPlan plan;
+        plan.setpoints.append(Setpoint{Units::Flow::fromUnits(2)});
+        plan.setpoints.append(Setpoint{Units::Flow::fromUnits(20)});
+        return plan;
+    }
+
+    /**
+     * @brief Загружает план из JSON-профиля.
+     *
+     * Профиль отклоняется целиком, если у уставки расход или допуск не
+     * больше нуля, @c timeoutMs не больше нуля, @c settlePulses меньше
+     * единицы или две уставки совпадают по расходу (после округления до
+     * разрешения устройства), а также если при заданном @c fitTolerance
+     * @c minPoints меньше @ref MIN_FIT_POINTS.
+     * @param path  Путь к файлу профиля.
+     * @param error Куда записать описание ошибки (может быть @c nullptr).
+     * @param plan  Результат; не изменяется при ошибке.
+     * @return @c true при успешной загрузке.
+     */
+    static bool load(const QString &path, CalibrationPlan *plan, QString *error = nullptr) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            if (error) *error = file.errorString();
+            return false;
+        }
+
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+        if (!doc.isObject()) {
+            if (error) *error = parseError.errorString();
+            return false;
+        }
+
+        const QJsonObject root = doc.object();
+        CalibrationPlan result;
+        result.name = root.value("name").toString(path);
+        result.fitTolerance = root.value("fitTolerance").toDouble(0.0);
+        const int minFitPoints = result.fitTolerance > 0 ? MIN_FIT_POINTS : 2;
+        result.minPoints = root.value("minPoints").toInt(minFitPoints);
+        if (result.minPoints < minFitPoints) {
+            if (error)
+                *error = QStringLiteral("\"minPoints\" must be at least %1 when \"fitTolerance\" is set")
+                    .arg(MIN_FIT_POINTS);
+            return false;
+        }
+        result.maxSlopeCI = root.value("maxSlopeCI").toDouble(0.0);
+        result.maxOffsetCI = root.value("maxOffsetCI").toDouble(0.0);
+        result.bootstrapResamples = qBound(100, root.value("bootstrapResamples").toInt(4000), 100000);
+
+        const Setpoint defaults{Units::Flow()};
+        for (const QJsonValue &value: root.value("setpoints").toArray()) {
+            const QJsonObject obj = value.toObject();
+            const QString where = QStringLiteral("setpoint %1: ").arg(result.setpoints.size() + 1);
+            if (!obj.contains("flow")) {
+                if (error) *error = where + QStringLiteral("no \"flow\"");
+                return false;
+            }
+            // значения профиля округляются до разрешения устройства
+            Setpoint sp{Units::Flow::fromDouble(obj.value("flow").toDouble())};
+            sp.tolerance = Units::Flow::fromDouble(obj.value("tolerance").toDouble(defaults.tolerance.toDouble()));
+            sp.settlePulses = obj.value("settlePulses").toInt(defaults.settlePulses);
+            sp.timeoutMs = obj.value("timeoutMs").toInt(defaults.timeoutMs);
+
+            QString invalid;
+            if (sp.flow <= Units::Flow())
+                invalid = QStringLiteral("\"flow\" must be positive");
+            else if (sp.tolerance <= Units::Flow())
+                invalid = QStringLiteral("\"tolerance\" must be positive");
+            else if (sp.timeoutMs <= 0)
+                invalid = QStringLiteral("\"timeoutMs\" must be positive");
+            else if (sp.settlePulses < 1)
+                invalid = QStringLiteral("\"settlePulses\" must be at least 1");
+            for (const Setpoint &other: result.setpoints)
+                if (invalid.isEmpty() && other.flow == sp.flow)
+                    invalid = QStringLiteral("flow %1 L/min is already in the plan").arg(sp.flow.toDouble());
+            if (!invalid.isEmpty()) {
+                if (error) *error = where + invalid;
+                return false;
+            }
+            result.setpoints.append(sp);
+        }
+
+        if (result.setpoints.size() < 2) {
+            if (error) *error = QStringLiteral("at least two setpoints are required");
+            return false;
+        }
+        // при уставках меньше MIN_FIT_POINTS досрочного завершения не бывает
+        result.minPoints = qMax(minFitPoints, qMin(result.minPoints, static_cast<int>(result.setpoints.size())));
+
+        *plan = result;
+        return true;
+    }
+};
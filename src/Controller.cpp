@@ -1,17 +1,37 @@
 #include "Controller.h"
+#include "ValveSimulator.h"
 
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QScreen>
 #include <QSerialPortInfo>
+#include <QtConcurrent/QtConcurrentRun>
 
 Controller::Controller(QObject *parent)
     : QObject(parent) {
-    m_timer.setInterval(100);
-    connect(&m_timer, &QTimer::timeout, this, &Controller::updateInsufflatorData);
+    // Публикация измерений в QML не чаще одного раза за кадр дисплея
+    const QScreen *screen = QGuiApplication::primaryScreen();
+    const qreal refreshRate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60.0;
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    m_frameTimer.setInterval(qMax(1, qRound(1000.0 / refreshRate)));
+    connect(&m_frameTimer, &QTimer::timeout, this, &Controller::publishValues);
+    m_frameTimer.start();
 
     // Таймер автосканирования COM-портов
     m_portsTimer.setInterval(1000);
     connect(&m_portsTimer, &QTimer::timeout, this, &Controller::refreshPorts);
     m_portsTimer.start();
 
+    // Следующий цикл soak-прогона запускается из цикла событий: текущая
+    // последовательность в этот момент ещё не вернулась
+    m_nextCycle.setSingleShot(true);
+    m_nextCycle.setInterval(0);
+    connect(&m_nextCycle, &QTimer::timeout, this, [this] {
+        if (m_soak.isActive() && m_connected && !m_running)
+            startRun();
+    });
+
     // Первичное наполнение списка портов
     refreshPorts();
 }
@@ -23,6 +43,18 @@ void Controller::setPortName(const QString &name) {
     emit portNameChanged();
 }
 
+void Controller::setProfilePath(const QString &path) {
+    const QString resolved = path.isEmpty() ? defaultProfilePath() : path;
+    if (m_profilePath == resolved)
+        return;
+    m_profilePath = resolved;
+    emit profilePathChanged();
+}
+
+QString Controller::defaultProfilePath() {
+    return QCoreApplication::applicationDirPath() + QStringLiteral("/calibration.json");
+}
+
 void Controller::refreshPorts() {
     QStringList ports;
     const auto available = QSerialPortInfo::availablePorts();
@@ -30,6 +62,7 @@ void Controller::refreshPorts() {
     for (const QSerialPortInfo &info: available) {
         ports.push_back(info.portName());
     }
+    ports.push_back(SimulatedUART::portName());
 
     if (ports == m_availablePorts)
         return;
@@ -42,18 +75,151 @@ void Controller::appendLog(const QString &line) {
     if (!m_logText.isEmpty())
         m_logText.append('\n');
     m_logText.append(line);
+
+    // в UI остаются последние MAX_LOG_LINES строк; полный журнал — в debug.log
+    for (m_logLines += line.count('\n') + 1; m_logLines > MAX_LOG_LINES; --m_logLines)
+        m_logText.remove(0, m_logText.indexOf('\n') + 1);
     emit logTextChanged();
 }
 
+void Controller::publishValues() {
+    SampleCoalescer::Snapshot snapshot;
+    if (!m_samples.take(&snapshot))
+        return;
+
+    m_pwm = snapshot.pwm;
+    // в плавающую точку значения переводятся только здесь, для интерфейса
+    m_flow = snapshot.flow.toDouble();
+    m_error = snapshot.error.toDouble();
+    m_pressure = snapshot.pressure.toDouble();
+    m_temperature = snapshot.temperature.toDouble();
+    m_flowMin = snapshot.flowMin.toDouble();
+    m_flowMax = snapshot.flowMax.toDouble();
+    emit valuesChanged();
+}
+
 void Controller::resetMeasurement() {
+    m_samples.clear();
     m_inValue = Insufflator::INValue{};
-    m_flowTarget = 2.0;
+    m_trace.clear();
+    m_points.clear();
+    m_settled.clear();
+    m_planIndex = 0;
     m_slope = 0.0;
     m_offset = 0;
+    m_fitCi = Bootstrap::LineFit{};
+    m_fitAccepted = true;
     emit calibrationChanged();
     emit resultChanged();
 }
 
+void Controller::openArchive() {
+    closeArchive();
+
+    const QDir dir(QCoreApplication::applicationDirPath() + QStringLiteral("/archive"));
+    dir.mkpath(QStringLiteral("."));
+    // миллисекунды и номер цикла: циклы soak-прогона идут чаще раза в секунду
+    QString name = QStringLiteral("session-%1-%2")
+        .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz"), m_portName);
+    if (m_soak.isActive())
+        name += QStringLiteral("-c%1").arg(m_soak.cycles().size() + 1, 4, 10, QLatin1Char('0'));
+    const QString path = dir.filePath(name + QStringLiteral(".vta"));
+    pruneArchives(dir);
+
+    m_archive = new SampleArchiveWriter(path);
+    if (!m_archive->isOpen()) {
+        appendLog(tr("Sample archive disabled: %1").arg(m_archive->errorString()));
+        delete m_archive;
+        m_archive = nullptr;
+    }
+}
+
+void Controller::pruneArchives(const QDir &dir) {
+    // имена начинаются с метки времени, поэтому по имени — от старых к новым
+    const QFileInfoList files = dir.entryInfoList({QStringLiteral("session-*.vta")}, QDir::Files, QDir::Name);
+    qint64 total = 0;
+    for (const QFileInfo &f: files)
+        total += f.size();
+
+    // место под новый архив
+    qsizetype count = files.size() + 1;
+    for (const QFileInfo &f: files) {
+        if (count <= MAX_ARCHIVE_FILES && total <= MAX_ARCHIVE_BYTES)
+            break;
+        if (!QFile::remove(f.filePath()))
+            continue;
+        total -= f.size();
+        --count;
+    }
+}
+
+void Controller::closeArchive() {
+    delete m_archive;
+    m_archive = nullptr;
+}
+
+void Controller::publishTelemetry(Units::Flow flow) {
+    Telemetry::Sample sample;
+    sample.timestampUs = QDateTime::currentMSecsSinceEpoch() * 1000;
+    sample.flow = static_cast<float>(flow.toDouble());
+    sample.error = static_cast<float>(m_in->error.toDouble());
+    sample.pressure = static_cast<float>(m_in->pressure.toDouble());
+    sample.temperature = static_cast<float>(m_in->temperature.toDouble());
+    sample.pwm = m_in->pwm;
+    sample.status = (m_running ? Telemetry::RUNNING : 0u) |
+                    (m_in->valveOn() ? Telemetry::VALVE_ON : 0u) |
+                    (static_cast<uint32_t>(m_data->alarm()) << 8) |
+                    (static_cast<uint32_t>(m_planIndex) << 16);
+    m_telemetry->publish(sample);
+
+    metrics().flow.set(flow.toDouble());
+    metrics().pwm.set(m_in->pwm);
+    metrics().linkUtilisation.set(m_in->linkUtilisation());
+}
+
+void Controller::identifyPlant() {
+    const PlantModel::Fit fit = PlantModel::identify(m_trace);
+    if (!fit.ok) {
+        appendLog(tr("Plant model: identification failed, keeping gain=%1, pulse=%2, pause=%3")
+            .arg(m_tuning.pwmPerFlow, 0, 'f', 1)
+            .arg(m_tuning.pulseTime)
+            .arg(m_tuning.pause));
+        return;
+    }
+
+    m_tuning = PlantModel::tune(fit, m_tuning);
+    appendLog(tr("Plant model: K=%1 L/min per PWM, tau=%2 ticks, dead=%3 ticks, rms=%4")
+        .arg(fit.gain, 0, 'g', 3)
+        .arg(fit.tauTicks, 0, 'f', 1)
+        .arg(fit.deadTicks)
+        .arg(fit.rms, 0, 'f', 3));
+    appendLog(tr("Next run: gain=%1, pulse=%2, pause=%3")
+        .arg(m_tuning.pwmPerFlow, 0, 'f', 1)
+        .arg(m_tuning.pulseTime)
+        .arg(m_tuning.pause));
+}
+
+bool Controller::abortOnAlarm() {
+    const unsigned char sig = m_data->alarm();
+    if (!sig)
+        return false;
+
+    m_running = false;
+    emit runningChanged();
+    metrics().running.set(0);
+    closeArchive();
+    metrics().calibrationsAborted.inc();
+
+    // редуктор перекрывает транспорт; подачу газа выключаем с подтверждением
+    stopFlow();
+
+    const QString message = tr("Tuning aborted: alarm %1").arg(QString::fromLatin1(INSUF::alarmName(sig)));
+    appendLog(message);
+    emit errorOccurred(message);
+    interruptSoak();
+    return true;
+}
+
 void Controller::connectOrDisconnect() {
     if (!m_connected) {
         if (m_portName.isEmpty()) {
@@ -62,16 +228,40 @@ void Controller::connectOrDisconnect() {
         }
 
         // global uart lives in this translation unit (see SendAndReadData.h)
-        uart = new UART(m_portName);
+        if (m_portName == SimulatedUART::portName())
+            uart = new SimulatedUART(m_portName);
+        else
+            uart = new UART(m_portName);
         if (!uart->initUART()) {
             delete uart;
             uart = nullptr;
+            metrics().portErrors.inc();
             emit errorOccurred(tr("Could not connect to the port"));
             return;
         }
 
         m_data = new Data(m_portName);
 
+        m_telemetry = new TelemetryWriter(Telemetry::key(m_portName));
+        if (!m_telemetry->isValid())
+            appendLog(tr("Telemetry export disabled: %1").arg(m_telemetry->errorString()));
+        m_data->subscribe(INSUF::ADDRESS, Data::ANY, [this](const Data::DataNode &node) {
+            const unsigned char sig = static_cast<unsigned char>(node.tag);
+            if (!INSUF::isAlarm(sig))
+                return;
+            appendLog(tr("Alarm: %1").arg(QString::fromLatin1(INSUF::alarmName(sig))));
+
+            // редуктор перекрывает транспорт; настройку прерываем из цикла событий,
+            // т.к. обработчик может вызываться изнутри самой последовательности
+            if (m_data->alarm() == sig)
+                QMetaObject::invokeMethod(this, [this] {
+                    if (!m_running || !m_data || !m_data->alarm())
+                        return;
+                    m_run = {};
+                    abortOnAlarm();
+                }, Qt::QueuedConnection);
+        });
+
         m_connected = true;
         appendLog(tr("Connected to %1").arg(m_portName));
         emit connectedChanged();
@@ -79,30 +269,74 @@ void Controller::connectOrDisconnect() {
         // при подключении можно остановить автосканирование портов
         m_portsTimer.stop();
     } else {
-        m_timer.stop();
+        // отключение уже идёт: ждём подтверждения от устройства
+        if (m_closePort)
+            return;
+
+        m_run = {};
         m_running = false;
         emit runningChanged();
+        metrics().running.set(0);
+        closeArchive();
+        interruptSoak();
 
-        delete m_in;
-        m_in = nullptr;
+        // порт закрывается, когда устройство подтвердит отключение подачи
+        m_closePort = true;
+        stopFlow();
+    }
+}
 
-        delete m_data;
-        m_data = nullptr;
+void Controller::quit() {
+    m_quit = true;
+    if (m_connected)
+        connectOrDisconnect();
+    else
+        QCoreApplication::quit();
+}
 
-        if (uart) {
-            uart->closeUART();
-            delete uart;
-            uart = nullptr;
-        }
+void Controller::stopFlow() {
+    if (m_stop.isRunning())
+        return;
+    m_stop = shutDown();
+    m_stop.start();
+}
 
-        m_connected = false;
-        appendLog(tr("Disconnected"));
-        emit connectedChanged();
+Coro::Task<> Controller::shutDown() {
+    if (m_in) {
+        const bool stopped = co_await m_in->stop();
+        if (!stopped)
+            appendLog(tr("The device did not confirm the gas shut-off"));
+        m_in.reset();
+    }
+    if (m_closePort)
+        closePort();
+}
+
+void Controller::closePort() {
+    m_closePort = false;
 
-        // при отключении снова начинаем сканировать порты
-        if (!m_portsTimer.isActive())
-            m_portsTimer.start();
+    delete m_data;
+    m_data = nullptr;
+
+    delete m_telemetry;
+    m_telemetry = nullptr;
+
+    if (uart) {
+        uart->closeUART();
+        delete uart;
+        uart = nullptr;
     }
+
+    m_connected = false;
+    appendLog(tr("Disconnected"));
+    emit connectedChanged();
+
+    // при отключении снова начинаем сканировать порты
+    if (!m_portsTimer.isActive())
+        m_portsTimer.start();
+
+    if (m_quit)
+        QCoreApplication::quit();
 }
 
 void Controller::startOrStop() {
@@ -112,84 +346,352 @@ void Controller::startOrStop() {
     }
 
     if (!m_running) {
-        resetMeasurement();
-        delete m_in;
-        m_in = nullptr;
-
-        m_running = true;
-        emit runningChanged();
-        m_timer.start();
+        // стоп между циклами soak-прогона: следующий цикл не запускаем
+        if (m_soak.isActive()) {
+            interruptSoak();
+            return;
+        }
+        if (m_stop.isRunning()) {
+            emit errorOccurred(tr("The gas flow is still being shut off"));
+            return;
+        }
+        startRun();
     } else {
-        m_timer.stop();
+        // отмена сопрограммы, затем подача отключается с подтверждением
+        m_run = {};
         m_running = false;
         emit runningChanged();
+        metrics().running.set(0);
+        closeArchive();
+        interruptSoak();
 
-        delete m_in;
-        m_in = nullptr;
+        stopFlow();
     }
 }
 
-void Controller::updateInsufflatorData() {
-    if (!m_data)
+void Controller::startRun() {
+    resetMeasurement();
+    loadPlan();
+    m_data->clearAlarm();
+    m_in.reset();
+
+    m_running = true;
+    emit runningChanged();
+    metrics().running.set(1);
+    m_runClock.start();
+    openArchive();
+    if (m_soak.isActive())
+        m_soak.beginCycle();
+    m_run = calibrate();
+    m_run.start();
+}
+
+void Controller::startSoak(int cycles, int minutes) {
+    if (!m_connected) {
+        emit errorOccurred(tr("Connect to the device first"));
         return;
+    }
+    if (m_running || m_stop.isRunning()) {
+        emit errorOccurred(tr("Stop the current calibration first"));
+        return;
+    }
+
+    m_soak.start(cycles, qint64(minutes) * 60000);
+    appendLog(tr("Soak started: %1 cycles, %2 min")
+        .arg(cycles > 0 ? QString::number(cycles) : tr("unlimited"))
+        .arg(minutes > 0 ? QString::number(minutes) : tr("unlimited")));
+    startRun();
+}
+
+void Controller::continueSoak(bool ok) {
+    if (!m_soak.isActive())
+        return;
+
+    const SoakMonitor::Cycle &c = m_soak.endCycle(ok);
+    appendLog(tr("Soak cycle %1 %2: %3 s, RSS %4 MiB, %5 allocations, %6 live blocks, RTT %7 ms")
+        .arg(c.number)
+        .arg(ok ? tr("ok") : tr("failed"))
+        .arg(c.seconds, 0, 'f', 1)
+        .arg(c.rssMiB, 0, 'f', 1)
+        .arg(qint64(c.allocations))
+        .arg(qint64(c.liveBlocks))
+        .arg(c.rttMs, 0, 'f', 2));
+
+    if (m_soak.wantsAnotherCycle())
+        m_nextCycle.start();
+    else
+        finishSoak();
+}
+
+void Controller::interruptSoak() {
+    m_nextCycle.stop();
+    if (!m_soak.isActive())
+        return;
+    if (m_soak.inCycle())
+        m_soak.endCycle(false);
+    appendLog(tr("Soak interrupted"));
+    finishSoak();
+}
+
+void Controller::finishSoak() {
+    m_soak.stop();
+    for (const QString &line: m_soak.summary())
+        appendLog(line);
+
+    const QString path = QCoreApplication::applicationDirPath() + QStringLiteral("/soak-%1.csv")
+        .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"));
+    QString error;
+    if (m_soak.writeCsv(path, &error))
+        appendLog(tr("Soak cycles saved to %1").arg(path));
+    else
+        appendLog(tr("Soak cycles not saved: %1").arg(error));
+}
+
+void Controller::loadPlan() {
+    const QString &path = m_profilePath;
+    m_plan = CalibrationPlan::defaultPlan();
+
+    if (QFile::exists(path)) {
+        QString error;
+        if (!CalibrationPlan::load(path, &m_plan, &error))
+            appendLog(tr("Calibration profile %1 rejected: %2").arg(path, error));
+    } else if (path != defaultProfilePath()) {
+        appendLog(tr("Calibration profile %1 not found, using the default plan").arg(path));
+    }
+
+    QStringList flows;
+    for (const CalibrationPlan::Setpoint &sp: m_plan.setpoints)
+        flows << QString::number(sp.flow.toDouble(), 'f', 1);
+    appendLog(tr("Calibration plan \"%1\": %2 L/min").arg(m_plan.name, flows.join(" -> ")));
+}
+
+void Controller::finishPhase(bool reached) {
+    const CalibrationPlan::Setpoint &sp = m_plan.setpoints[m_planIndex];
+
+    metrics().phaseSeconds.observe(m_phaseClock.elapsed() / 1000.0);
 
-    if (m_flowTarget == 2.0) {
-        if (m_in != nullptr) {
-            m_in->algorithms();
-            m_pwm = m_in->pwm;
-            m_flow = m_in->currentFlow;
-            m_error = m_in->error;
-            emit valuesChanged();
-
-            if (std::fabs(m_in->error) < 0.3) {
-                m_inValue.PWM1 = m_pwm;
-                m_inValue.FLOW1 = m_flow;
-                m_flowTarget = 20.0;
-                appendLog(tr("Point 1: PWM=%1, FLOW=%2")
-                    .arg(m_inValue.PWM1)
-                    .arg(m_inValue.FLOW1, 0, 'f', 3));
-                delete m_in;
-                m_in = nullptr;
-                emit calibrationChanged();
-            }
-        } else {
-            m_in = new Insufflator(m_data, m_flowTarget);
+    if (reached) {
+        metrics().pulsesToConverge.observe(m_in->pulses);
+        const Insufflator::Point point{m_in->pwm, m_in->currentFlow};
+        m_points.append(point);
+        appendLog(tr("Point %1: PWM=%2, FLOW=%3")
+            .arg(m_points.size())
+            .arg(point.pwm)
+            .arg(point.flow.toDouble(), 0, 'f', 3));
+
+        // первые две точки по-прежнему показываются в интерфейсе
+        if (m_points.size() == 1) {
+            m_inValue.PWM1 = point.pwm;
+            m_inValue.FLOW1 = point.flow.toDouble();
+        } else if (m_points.size() == 2) {
+            m_inValue.PWM2 = point.pwm;
+            m_inValue.FLOW2 = point.flow.toDouble();
         }
-    } else if (m_flowTarget == 20.0) {
-        if (m_in != nullptr) {
-            m_in->algorithms();
-            m_pwm = m_in->pwm;
-            m_flow = m_in->currentFlow;
-            m_error = m_in->error;
-            emit valuesChanged();
-
-            if (std::fabs(m_in->error) < 0.3) {
-                m_inValue.PWM2 = m_pwm;
-                m_inValue.FLOW2 = m_flow;
-                m_flowTarget = 0.0;
-                appendLog(tr("Point 2: PWM=%1, FLOW=%2")
-                    .arg(m_inValue.PWM2)
-                    .arg(m_inValue.FLOW2, 0, 'f', 3));
-                delete m_in;
-                m_in = nullptr;
-                emit calibrationChanged();
-            }
-        } else {
-            m_in = new Insufflator(m_data, m_flowTarget);
+        emit calibrationChanged();
+
+        // группа добавляется и пустой: уставка без установившихся измерений не даёт интервалов
+        m_settled.append(m_phaseSettled);
+    } else {
+        metrics().setpointTimeouts.inc();
+        appendLog(tr("Setpoint %1 L/min timed out after %2 pulses (error=%3)")
+            .arg(sp.flow.toDouble(), 0, 'f', 1)
+            .arg(m_in->pulses)
+            .arg(m_in->error.toDouble(), 0, 'f', 3));
+    }
+
+    appendLog(tr("Polling: %1").arg(m_in->pollingReport()));
+    m_trace.push_back(m_in->trace());
+    m_in.reset();
+    ++m_planIndex;
+
+    if (m_points.size() >= qMax(m_plan.minPoints, CalibrationPlan::MIN_FIT_POINTS) && m_plan.fitTolerance > 0 &&
+        m_planIndex < m_plan.setpoints.size()) {
+        double rms = 0;
+        Insufflator::approximate(m_points, &rms);
+        if (rms <= m_plan.fitTolerance) {
+            appendLog(tr("Fit residual %1 L/min is within %2, skipping %3 remaining setpoints")
+                .arg(rms, 0, 'f', 3)
+                .arg(m_plan.fitTolerance, 0, 'f', 3)
+                .arg(m_plan.setpoints.size() - m_planIndex));
+            m_planIndex = m_plan.setpoints.size();
         }
-    } else if ((m_inValue.PWM1 > 0) && (m_inValue.PWM2 > 0) &&
-               (m_inValue.FLOW1 > 0.0) && (m_inValue.FLOW2 > 0.0)) {
-        auto res = Insufflator::approximate(m_inValue);
-        m_slope = res.slope;
-        m_offset = res.offset;
-        emit resultChanged();
-
-        appendLog(tr("Approximation: slope=%1, offset=%2")
-            .arg(m_slope, 0, 'f', 2)
-            .arg(m_offset));
-
-        m_timer.stop();
-        m_running = false;
-        emit runningChanged();
     }
 }
+
+Coro::Task<> Controller::finishRun() {
+    closeArchive();
+    metrics().calibrationSeconds.observe(m_runClock.elapsed() / 1000.0);
+
+    // оценка и интервалы считаются в пуле потоков по копии измерений;
+    // запуск остаётся активным, пока расчёт не закончится
+    QElapsedTimer bootstrapClock;
+    bootstrapClock.start();
+    if (m_points.size() >= 2) {
+        const QVector<QVector<Bootstrap::Sample>> settled = m_settled;
+        const int resamples = m_plan.bootstrapResamples;
+        m_fitCi = co_await Coro::resultOf(QtConcurrent::run([settled, resamples] {
+            return Bootstrap::fitLine(settled, resamples);
+        }));
+    }
+    const qint64 bootstrapMs = bootstrapClock.elapsed();
+
+    m_running = false;
+    emit runningChanged();
+    metrics().running.set(0);
+
+    if (m_points.size() < 2) {
+        const QString message = tr("Calibration failed: %1 of %2 setpoints reached")
+            .arg(m_points.size())
+            .arg(m_plan.setpoints.size());
+        appendLog(message);
+        emit errorOccurred(message);
+        metrics().calibrationsFailed.inc();
+        continueSoak(false);
+        co_return;
+    }
+
+    int samples = 0;
+    int smallest = 0;
+    for (int i = 0; i < m_settled.size(); ++i) {
+        samples += m_settled[i].size();
+        if (m_settled[i].size() < m_settled[smallest].size())
+            smallest = i;
+    }
+
+    const Bootstrap::Line &line = m_fitCi.estimate;
+    if (!line.valid()) {
+        const QString message = tr("Calibration failed: PWM does not change with flow across %1 settled samples")
+            .arg(samples);
+        appendLog(message);
+        emit errorOccurred(message);
+        metrics().calibrationsFailed.inc();
+        continueSoak(false);
+        co_return;
+    }
+    m_slope = std::round(line.slope * 100) / 100;
+    m_offset = qRound(line.offset);
+
+    appendLog(tr("Approximation: slope=%1, offset=%2, residual=%3 L/min (%4 settled samples)")
+        .arg(m_slope, 0, 'f', 2)
+        .arg(m_offset)
+        .arg(line.rms, 0, 'f', 3)
+        .arg(samples));
+
+    QString rejection;
+    if (m_fitCi.ok) {
+        appendLog(tr("95% CI: slope %1..%2, offset %3..%4 (%5 resamples in %6 ms)")
+            .arg(m_fitCi.slope.low, 0, 'f', 2)
+            .arg(m_fitCi.slope.high, 0, 'f', 2)
+            .arg(m_fitCi.offset.low, 0, 'f', 0)
+            .arg(m_fitCi.offset.high, 0, 'f', 0)
+            .arg(m_fitCi.resamples)
+            .arg(bootstrapMs));
+        if (m_plan.maxSlopeCI > 0 && m_fitCi.slope.width() > m_plan.maxSlopeCI)
+            rejection = tr("slope interval %1 is wider than %2")
+                .arg(m_fitCi.slope.width(), 0, 'f', 2).arg(m_plan.maxSlopeCI, 0, 'f', 2);
+        else if (m_plan.maxOffsetCI > 0 && m_fitCi.offset.width() > m_plan.maxOffsetCI)
+            rejection = tr("offset interval %1 is wider than %2")
+                .arg(m_fitCi.offset.width(), 0, 'f', 0).arg(m_plan.maxOffsetCI, 0, 'f', 0);
+    } else {
+        const QString reason = m_settled[smallest].size() < Bootstrap::MIN_GROUP_SAMPLES
+            ? tr("%1 L/min has %2 settled samples, %3 needed")
+                .arg(m_points[smallest].flow.toDouble(), 0, 'f', 1)
+                .arg(m_settled[smallest].size())
+                .arg(Bootstrap::MIN_GROUP_SAMPLES)
+            : tr("no resample gave a line");
+        appendLog(tr("95% CI not computed: %1").arg(reason));
+        if (m_plan.maxSlopeCI > 0 || m_plan.maxOffsetCI > 0)
+            rejection = tr("confidence interval could not be computed (%1)").arg(reason);
+    }
+
+    m_fitAccepted = rejection.isEmpty();
+    emit resultChanged();
+
+    if (!m_fitAccepted) {
+        const QString message = tr("Calibration rejected: %1, re-run recommended").arg(rejection);
+        appendLog(message);
+        emit errorOccurred(message);
+        metrics().calibrationsFailed.inc();
+        continueSoak(false);
+        co_return;
+    }
+
+    metrics().calibrationsOk.inc();
+    identifyPlant();
+    continueSoak(true);
+}
+
+Coro::Task<> Controller::calibrate() {
+    Coro::Ticker ticker(Insufflator::TICK_MS);
+    while (m_planIndex < m_plan.setpoints.size()) {
+        const bool reached = co_await runPhase(m_plan.setpoints[m_planIndex], ticker);
+        if (abortOnAlarm())
+            co_return;
+        finishPhase(reached);
+    }
+    co_await finishRun();
+}
+
+Coro::Task<bool> Controller::runPhase(CalibrationPlan::Setpoint sp, Coro::Ticker &ticker) {
+    m_in.emplace(m_data, sp.flow, m_tuning, Insufflator::predictPwm(m_points, sp.flow));
+    // каждое измерение расхода уже попадает в архив; в debug.log оно только раздувает файл
+    m_in->setFlowLogged(!m_archive);
+    m_in->onFlowSample([this](Units::Flow flow) { recordSample(flow); });
+    m_phaseSettled.clear();
+    m_prevFlow.reset();
+    const bool started = co_await m_in->start();
+    bool reached = false;
+    if (started) {
+        m_phaseClock.start();
+        reached = co_await settle(sp, ticker);
+    } else if (!m_data->alarm()) {
+        appendLog(tr("Setpoint %1 L/min: the device did not answer the start sequence")
+            .arg(sp.flow.toDouble(), 0, 'f', 1));
+    }
+
+    // подачу могли включить и при неудачном запуске — отключаем всегда
+    const bool stopped = co_await m_in->stop();
+    if (!stopped)
+        appendLog(tr("Setpoint %1 L/min: the device did not confirm the gas shut-off")
+            .arg(sp.flow.toDouble(), 0, 'f', 1));
+    co_return reached;
+}
+
+Coro::Task<bool> Controller::settle(CalibrationPlan::Setpoint sp, Coro::Ticker &ticker) {
+    int settledPulses = 0;
+    int lastPulse = 0;
+    while (m_phaseClock.elapsed() <= sp.timeoutMs) {
+        co_await ticker.next();
+        co_await m_in->algorithms();
+        if (m_data->alarm())
+            co_return false;
+        recordTick(sp);
+
+        // ошибка пересчитывается раз за импульс — окно установления считаем в импульсах
+        if (m_in->pulses != lastPulse) {
+            lastPulse = m_in->pulses;
+            settledPulses = m_in->error.abs() < sp.tolerance ? settledPulses + 1 : 0;
+            if (settledPulses >= sp.settlePulses)
+                co_return true;
+        }
+    }
+    co_return false;
+}
+
+void Controller::recordSample(Units::Flow flow) {
+    m_samples.pushFlow(flow);
+    publishTelemetry(flow);
+    if (m_archive)
+        m_archive->append({QDateTime::currentMSecsSinceEpoch(), flow.raw(), m_in->pwm});
+}
+
+void Controller::recordTick(const CalibrationPlan::Setpoint &sp) {
+    m_samples.pushState(m_in->pwm, m_in->error, m_in->pressure, m_in->temperature);
+
+    // установившееся измерение для доверительных интервалов: клапан открыт,
+    // расход в допуске уставки и почти не меняется от тика к тику
+    if (m_in->valveOn() && m_prevFlow && (m_in->currentFlow - sp.flow).abs() <= sp.tolerance &&
+        (m_in->currentFlow - *m_prevFlow).abs() * 2 <= sp.tolerance)
+        m_phaseSettled.append({m_in->currentFlow.toDouble(), double(m_in->pwm)});
+    m_prevFlow = m_in->currentFlow;
+}
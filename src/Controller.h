@@ -11,10 +11,20 @@
 
 #pragma once
 
+#include <QDir>
+#include <QElapsedTimer>
 #include <QTimer>
 
+#include <optional>
+
 #include "SendAndReadData.h"
 #include "Insufflator.h"
+#include "SampleCoalescer.h"
+#include "CalibrationPlan.h"
+#include "TelemetryRing.h"
+#include "SampleArchive.h"
+#include "SoakMonitor.h"
+#include "Bootstrap.h"
 
 /**
  * @brief Контроллер приложения, доступный из QML.
@@ -39,6 +49,8 @@ class Controller : public QObject {
     Q_PROPERTY(bool connected READ isConnected NOTIFY connectedChanged)
     /// @c true, если алгоритм настройки сейчас запущен.
     Q_PROPERTY(bool running READ isRunning NOTIFY runningChanged)
+    /// Путь к JSON-профилю плана калибровки; читается при каждом запуске.
+    Q_PROPERTY(QString profilePath READ profilePath WRITE setProfilePath NOTIFY profilePathChanged)
 
     /// Текущий PWM, рассчитанный алгоритмом.
     Q_PROPERTY(int pwm READ pwm NOTIFY valuesChanged)
@@ -46,6 +58,14 @@ class Controller : public QObject {
     Q_PROPERTY(double flow READ flow NOTIFY valuesChanged)
     /// Текущая ошибка регулирования (расход - целевое значение).
     Q_PROPERTY(double error READ error NOTIFY valuesChanged)
+    /// Текущее измеренное давление инсуффляции (мм рт. ст.).
+    Q_PROPERTY(double pressure READ pressure NOTIFY valuesChanged)
+    /// Текущая температура корпуса (°C).
+    Q_PROPERTY(double temperature READ temperature NOTIFY valuesChanged)
+    /// Минимальный расход за последний кадр отображения.
+    Q_PROPERTY(double flowMin READ flowMin NOTIFY valuesChanged)
+    /// Максимальный расход за последний кадр отображения.
+    Q_PROPERTY(double flowMax READ flowMax NOTIFY valuesChanged)
 
     /// PWM первой калибровочной точки.
     Q_PROPERTY(int pwm1 READ pwm1 NOTIFY calibrationChanged)
@@ -60,6 +80,16 @@ class Controller : public QObject {
     Q_PROPERTY(double slope READ slope NOTIFY resultChanged)
     /// Смещение (offset) прямой аппроксимации.
     Q_PROPERTY(int offset READ offset NOTIFY resultChanged)
+    /// Нижняя граница 95% доверительного интервала наклона (NaN — не вычислена).
+    Q_PROPERTY(double slopeLow READ slopeLow NOTIFY resultChanged)
+    /// Верхняя граница 95% доверительного интервала наклона.
+    Q_PROPERTY(double slopeHigh READ slopeHigh NOTIFY resultChanged)
+    /// Нижняя граница 95% доверительного интервала смещения.
+    Q_PROPERTY(double offsetLow READ offsetLow NOTIFY resultChanged)
+    /// Верхняя граница 95% доверительного интервала смещения.
+    Q_PROPERTY(double offsetHigh READ offsetHigh NOTIFY resultChanged)
+    /// @c false, если интервалы шире допустимого профилем и калибровка отклонена.
+    Q_PROPERTY(bool fitAccepted READ fitAccepted NOTIFY resultChanged)
 
     /// Текстовый лог важных событий, отображаемый в интерфейсе.
     Q_PROPERTY(QString logText READ logText NOTIFY logTextChanged)
@@ -73,6 +103,14 @@ public:
     /// Устанавливает имя порта. Вызывает сигнал portNameChanged() при изменении.
     void setPortName(const QString &name);
 
+    /// Возвращает путь к профилю калибровки.
+    QString profilePath() const { return m_profilePath; }
+    /// Устанавливает путь к профилю калибровки (пустой — профиль по умолчанию).
+    void setProfilePath(const QString &path);
+
+    /// Профиль по умолчанию: calibration.json рядом с программой.
+    static QString defaultProfilePath();
+
     /// Возвращает список обнаруженных COM-портов.
     QStringList availablePorts() const { return m_availablePorts; }
 
@@ -87,6 +125,14 @@ public:
     double flow() const { return m_flow; }
     /// Возвращает текущую ошибку регулирования.
     double error() const { return m_error; }
+    /// Возвращает текущее давление инсуффляции.
+    double pressure() const { return m_pressure; }
+    /// Возвращает текущую температуру корпуса.
+    double temperature() const { return m_temperature; }
+    /// Возвращает минимальный расход за последний кадр.
+    double flowMin() const { return m_flowMin; }
+    /// Возвращает максимальный расход за последний кадр.
+    double flowMax() const { return m_flowMax; }
 
     /// PWM для первой калибровочной точки.
     int pwm1() const { return m_inValue.PWM1; }
@@ -101,21 +147,45 @@ public:
     double slope() const { return m_slope; }
     /// Возвращает текущее смещение прямой аппроксимации.
     int offset() const { return m_offset; }
+    /// Границы доверительного интервала наклона.
+    double slopeLow() const { return m_fitCi.slope.low; }
+    double slopeHigh() const { return m_fitCi.slope.high; }
+    /// Границы доверительного интервала смещения.
+    double offsetLow() const { return m_fitCi.offset.low; }
+    double offsetHigh() const { return m_fitCi.offset.high; }
+    /// Принята ли калибровка по ширине доверительных интервалов.
+    bool fitAccepted() const { return m_fitAccepted; }
 
     /// Возвращает накопленный текст лога.
     QString logText() const { return m_logText; }
 
     /// Подключается к устройству или отключается от него в зависимости от текущего состояния.
     Q_INVOKABLE void connectOrDisconnect();
-    /// Запускает или останавливает алгоритм настройки в зависимости от текущего состояния.
+    /// Запускает или останавливает алгоритм настройки в зависимости от текущего состояния;
+    /// между циклами soak-прогона прерывает прогон.
     Q_INVOKABLE void startOrStop();
     /// Принудительно обновляет список доступных COM-портов.
     Q_INVOKABLE void refreshPorts();
+    /// Отключает подачу газа с подтверждением и закрывает порт, затем завершает приложение.
+    Q_INVOKABLE void quit();
+
+    /**
+     * @brief Запускает длительный (soak) прогон: калибровка повторяется циклами.
+     * @param cycles  Количество циклов (0 — не ограничено).
+     * @param minutes Длительность прогона (0 — не ограничена).
+     *
+     * По окончании в лог выводится сводка @ref SoakMonitor::summary(),
+     * а циклы сохраняются в soak-*.csv рядом с программой.
+     */
+    Q_INVOKABLE void startSoak(int cycles, int minutes);
 
 signals:
     /// Сигнал об изменении имени порта.
     void portNameChanged();
 
+    /// Сигнал об изменении пути к профилю калибровки.
+    void profilePathChanged();
+
     /// Сигнал об изменении списка доступных портов.
     void availablePortsChanged();
 
@@ -125,7 +195,7 @@ signals:
     /// Сигнал об изменении состояния алгоритма (запущен/остановлен).
     void runningChanged();
 
-    /// Сигнал об изменении текущих значений PWM/расход/ошибка.
+    /// Сигнал об изменении текущих значений PWM/расход/ошибка (не чаще раза за кадр).
     void valuesChanged();
 
     /// Сигнал об изменении калибровочных точек.
@@ -141,37 +211,178 @@ signals:
     void errorOccurred(const QString &message);
 
 private slots:
-    /// Периодически опрашивает алгоритм Insufflator и обновляет измерения.
-    void updateInsufflatorData();
+    /// Публикует накопленные за кадр измерения в QML.
+    void publishValues();
 
 private:
     /// Добавляет строку в текстовый лог и испускает сигнал logTextChanged().
     void appendLog(const QString &line);
 
+    /// Загружает план калибровки из @ref profilePath (или план по умолчанию).
+    void loadPlan();
+
+    /**
+     * @brief Завершает текущую уставку плана и переходит к следующей.
+     * @param reached @c true — уставка достигнута и точка записана, @c false — тайм-аут.
+     */
+    void finishPhase(bool reached);
+
+    /**
+     * @brief Завершает запуск: прямая и её интервалы по установившимся измерениям, идентификация клапана.
+     *
+     * Бутстреп выполняется в пуле потоков; поток интерфейса в это время свободен.
+     */
+    Coro::Task<> finishRun();
+
+    /**
+     * @brief Публикует измерение расхода в кольцо телеметрии разделяемой памяти.
+     *
+     * Вызывается на каждое измерение канала FLOW; ошибка, давление,
+     * температура и PWM берутся последние, они обновляются раз за тик.
+     */
+    void publishTelemetry(Units::Flow flow);
+
+    /// Открывает архив измерений нового запуска в каталоге archive рядом с программой.
+    void openArchive();
+
+    /// Закрывает архив текущего запуска.
+    void closeArchive();
+
+    /// Удаляет старейшие архивы в @p dir сверх @ref MAX_ARCHIVE_FILES и @ref MAX_ARCHIVE_BYTES.
+    void pruneArchives(const QDir &dir);
+
+    /// Идентифицирует модель клапана по записи запуска и обновляет @ref m_tuning.
+    void identifyPlant();
+
+    /**
+     * @brief Отключает подачу газа с подтверждением устройства и разрушает алгоритм.
+     *
+     * Последовательность калибровки к этому моменту уже отменена (стоп,
+     * тревога, отключение). Если отключение запрошено (@ref m_closePort),
+     * порт закрывается только после ответа устройства на команды
+     * отключения или исчерпания их повторов.
+     */
+    Coro::Task<> shutDown();
+
+    /// Запускает @ref shutDown(), если он ещё не идёт.
+    void stopFlow();
+
+    /// Закрывает порт и освобождает транспорт; при выходе завершает приложение.
+    void closePort();
+
     /// Сбрасывает состояние измерений/калибровки в исходное.
     void resetMeasurement();
 
+    /// Начинает запуск калибровки (очередной цикл soak-прогона).
+    void startRun();
+
+    /**
+     * @brief Последовательность калибровки: уставки плана по очереди, затем итог.
+     *
+     * Выполняется сопрограммой в потоке интерфейса; отменяется
+     * разрушением @ref m_run (стоп, отключение).
+     */
+    Coro::Task<> calibrate();
+
+    /**
+     * @brief Одна уставка: подготовка устройства, установление расхода, отключение потока.
+     * @return @c true, если уставка достигнута.
+     */
+    Coro::Task<bool> runPhase(CalibrationPlan::Setpoint sp, Coro::Ticker &ticker);
+
+    /**
+     * @brief Ведёт регулирование по тикам, пока ошибка не продержится в допуске
+     *        @c settlePulses импульсов подряд или не истечёт время уставки.
+     * @return @c true, если расход установился; @c false — тайм-аут или тревога.
+     */
+    Coro::Task<bool> settle(CalibrationPlan::Setpoint sp, Coro::Ticker &ticker);
+
+    /// Учитывает измерение расхода сразу по приходу от планировщика опроса (чаще тика): интерфейс, телеметрия, архив.
+    void recordSample(Units::Flow flow);
+
+    /// Учитывает измерения очередного тика: интерфейс, установившиеся отсчёты.
+    void recordTick(const CalibrationPlan::Setpoint &sp);
+
+    /**
+     * @brief Записывает цикл soak-прогона и запускает следующий или подводит итог.
+     * @param ok Калибровка цикла завершилась успешно.
+     */
+    void continueSoak(bool ok);
+
+    /// Прерывает soak-прогон, если он идёт (стоп, отключение, тревога), и отменяет запуск следующего цикла.
+    void interruptSoak();
+
+    /// Выводит сводку soak-прогона в лог и сохраняет циклы в CSV.
+    void finishSoak();
+
+    /**
+     * @brief Прерывает настройку, если транспорт зафиксировал критическую тревогу.
+     *
+     * Вызывается из последовательности калибровки после каждой фазы и,
+     * отложенно, сразу по приходу тревоги — тогда последовательность
+     * отменяется, не дожидаясь конца фазы.
+     * @return @c true, если настройка была прервана.
+     */
+    bool abortOnAlarm();
+
     QString m_portName;        ///< Выбранное имя последовательного порта.
+    QString m_profilePath = defaultProfilePath(); ///< Профиль плана калибровки.
     bool m_connected = false;  ///< Текущее состояние соединения с устройством.
     bool m_running = false;    ///< Флаг: алгоритм настройки запущен или нет.
 
-    QTimer m_timer;       ///< Таймер, по которому вызывается обновление измерений.
     QTimer m_portsTimer;  ///< Таймер периодического сканирования COM-портов.
+    QTimer m_frameTimer;  ///< Таймер публикации измерений с частотой кадров дисплея.
+    QTimer m_nextCycle;   ///< Отложенный запуск следующего цикла soak-прогона.
+
+    SampleCoalescer m_samples;  ///< Измерения, накопленные с последней публикации.
 
     Data *m_data = nullptr;              ///< Обёртка над UART с протоколом устройства.
-    Insufflator *m_in = nullptr;         ///< Текущий экземпляр алгоритма Insufflator.
+    std::optional<Insufflator> m_in;     ///< Алгоритм текущей уставки (без выделения памяти на каждую).
+    Coro::Task<> m_run;                  ///< Последовательность калибровки (разрушается раньше @ref m_in).
+    Coro::Task<> m_stop;                 ///< Отключение подачи (@ref shutDown(); разрушается раньше @ref m_in).
+    bool m_closePort = false;            ///< После отключения подачи закрыть порт.
+    bool m_quit = false;                 ///< После закрытия порта завершить приложение.
+    TelemetryWriter *m_telemetry = nullptr; ///< Кольцо телеметрии для локальных процессов.
+    SampleArchiveWriter *m_archive = nullptr; ///< Архив измерений текущего запуска.
     Insufflator::INValue m_inValue{};    ///< Сохранённые калибровочные точки.
 
-    double m_flowTarget = 2.0;  ///< Целевое значение расхода в текущей фазе.
+    SoakMonitor m_soak;                  ///< Циклы soak-прогона.
+
+    std::vector<PlantModel::Trace> m_trace; ///< Записи тиков по фазам текущего запуска.
+    PlantModel::Tuning m_tuning;             ///< Настройки регулятора для следующих запусков.
+
+    CalibrationPlan m_plan;                 ///< Активный план калибровки.
+    int m_planIndex = 0;                    ///< Индекс текущей уставки плана.
+    QVector<Insufflator::Point> m_points;   ///< Снятые калибровочные точки.
+    QElapsedTimer m_phaseClock;             ///< Время с начала текущей уставки.
+    QElapsedTimer m_runClock;               ///< Время с начала запуска калибровки.
+    QVector<Bootstrap::Sample> m_phaseSettled;          ///< Установившиеся измерения текущей уставки.
+    QVector<QVector<Bootstrap::Sample>> m_settled;      ///< Установившиеся измерения достигнутых уставок.
+    std::optional<Units::Flow> m_prevFlow;  ///< Расход на предыдущем тике уставки.
 
     int m_pwm = 0;          ///< Последнее вычисленное значение PWM.
     double m_flow = 0.0;    ///< Последнее измеренное значение расхода.
     double m_error = 0.0;   ///< Последняя ошибка регулирования.
+    double m_pressure = 0.0;    ///< Последнее измеренное давление инсуффляции.
+    double m_temperature = 0.0; ///< Последняя измеренная температура.
+    double m_flowMin = 0.0;     ///< Минимальный расход за последний кадр.
+    double m_flowMax = 0.0;     ///< Максимальный расход за последний кадр.
 
     double m_slope = 0.0;   ///< Наклон аппроксимирующей зависимости.
     int m_offset = 0;       ///< Смещение аппроксимирующей зависимости.
+    Bootstrap::LineFit m_fitCi;   ///< Доверительные интервалы наклона и смещения.
+    bool m_fitAccepted = true;    ///< Калибровка принята по ширине интервалов.
+
+    /// Сколько последних строк лога хранится для UI (длительные прогоны не растят память).
+    static constexpr int MAX_LOG_LINES = 1000;
+
+    /// Сколько архивов сессий хранится в каталоге archive (старейшие удаляются).
+    static constexpr int MAX_ARCHIVE_FILES = 500;
+    /// Предельный суммарный размер архивов сессий.
+    static constexpr qint64 MAX_ARCHIVE_BYTES = qint64(1) << 30;
 
     QString m_logText;      ///< Сборный текстовый лог для отображения в UI.
+    int m_logLines = 0;     ///< Строк в @ref m_logText.
 
     QStringList m_availablePorts; ///< Кэшированный список доступных последовательных портов.
 };
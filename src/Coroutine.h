@@ -0,0 +1,399 @@
+/**
+ * @file Coroutine.h
+ * @brief Сопрограммы C++20 поверх цикла событий Qt: задачи, ожидание времени, тикер, блокировка.
+ */
+
+#pragma once
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/**
+ * @brief Примитивы для последовательностей, записанных прямолинейным кодом.
+ *
+ * Сопрограмма приостанавливается на @c co_await и продолжается из
+ * обработчика события Qt (срабатывание таймера, приход данных в порт),
+ * поэтому поток никогда не блокируется, а любое число последовательностей
+ * выполняется в одном потоке: приостановленная последовательность — это
+ * только её кадр в куче. Уничтожение @ref Task отменяет последовательность:
+ * кадры вложенных задач и объекты ожидания разрушаются, таймеры и подписки
+ * снимаются, продолжения уже не будет.
+ *
+ * Из обработчиков событий сопрограмма продолжается отложенно
+ * (@ref detail::resumeLater()): продолжившись, она разрушает объект
+ * ожидания вместе с его таймером, а таймер нельзя разрушать, пока он
+ * испускает свой сигнал.
+ *
+ * Исключения в проекте не используются: выброс исключения из сопрограммы
+ * завершает программу.
+ *
+ * Результат @c co_await сначала сохраняется в переменную и только потом
+ * проверяется: GCC 12.2 собирает сопрограмму с @c co_await прямо в условии
+ * @c if неверно — её тело не выполняется вовсе. Минимальный пример:
+ * tests/compiler/coawait-in-condition.cpp.
+ */
+namespace Coro {
+    template<typename T = void>
+    class Task;
+
+    namespace detail {
+        /**
+         * @brief Продолжает сопрограмму из цикла событий, а не из текущего обработчика.
+         *
+         * Вызов привязан к @p context: если он разрушен раньше (отмена
+         * сопрограммы вместе с объектом ожидания), продолжения не будет.
+         */
+        inline void resumeLater(QObject *context, std::coroutine_handle<> h) {
+            QMetaObject::invokeMethod(context, [h] { h.resume(); }, Qt::QueuedConnection);
+        }
+
+        /// Общая часть обещания: кто ждёт задачу и как к нему вернуться.
+        struct PromiseBase {
+            std::coroutine_handle<> continuation; ///< Ожидающая сопрограмма (пусто — задача верхнего уровня).
+
+            /// Передаёт управление ожидающей сопрограмме без роста стека.
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+
+                template<typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) const noexcept {
+                    const std::coroutine_handle<> next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            /// Задача ленивая: начинает выполняться при @c co_await или @ref Task::start().
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+
+        template<typename T>
+        struct Promise : PromiseBase {
+            T value{};
+
+            Task<T> get_return_object();
+            void return_value(T v) { value = std::move(v); }
+            T result() { return std::move(value); }
+        };
+
+        template<>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object();
+            void return_void() const noexcept {}
+            void result() const noexcept {}
+        };
+    }
+
+    /**
+     * @brief Сопрограмма с результатом @p T.
+     *
+     * Внутри другой сопрограммы ожидается через @c co_await; задача
+     * верхнего уровня запускается @ref start() и живёт, пока жив объект.
+     */
+    template<typename T>
+    class Task {
+    public:
+        using promise_type = detail::Promise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Task() = default;
+        explicit Task(Handle h) : m_handle(h) {}
+        Task(Task &&other) noexcept
+            : m_handle(std::exchange(other.m_handle, {})), m_started(std::exchange(other.m_started, false)) {}
+        Task &operator=(Task &&other) noexcept {
+            if (this != &other) {
+                if (m_handle)
+                    m_handle.destroy();
+                m_handle = std::exchange(other.m_handle, {});
+                m_started = std::exchange(other.m_started, false);
+            }
+            return *this;
+        }
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+
+        /// Разрушает кадр; незавершённая последовательность отменяется.
+        ~Task() {
+            if (m_handle)
+                m_handle.destroy();
+        }
+
+        /// Запускает задачу верхнего уровня (выполняется до первой приостановки).
+        void start() {
+            if (m_handle && !m_started) {
+                m_started = true;
+                m_handle.resume();
+            }
+        }
+
+        /// Задача создана и ещё не дошла до конца.
+        bool isRunning() const { return m_handle && m_started && !m_handle.done(); }
+
+        /// Ожидание задачи из другой сопрограммы: управление передаётся ей сразу.
+        auto operator co_await() && noexcept {
+            struct Awaiter {
+                Handle handle;
+
+                bool await_ready() const noexcept { return handle.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+                    handle.promise().continuation = caller;
+                    return handle;
+                }
+
+                T await_resume() { return handle.promise().result(); }
+            };
+            // у пустой задачи нет результата: ждать её — ошибка вызывающего
+            Q_ASSERT(m_handle);
+            m_started = true;
+            return Awaiter{m_handle};
+        }
+
+    private:
+        Handle m_handle;        ///< Кадр сопрограммы.
+        bool m_started = false; ///< Задача уже запущена.
+    };
+
+    template<typename T>
+    Task<T> detail::Promise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> detail::Promise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+    }
+
+    /**
+     * @brief Ожидание заданного времени: @c co_await Coro::sleep(2000).
+     *
+     * Таймер принадлежит объекту ожидания в кадре сопрограммы и
+     * останавливается вместе с ним при отмене.
+     */
+    class Sleep {
+    public:
+        explicit Sleep(int ms) : m_ms(ms) {}
+
+        bool await_ready() const noexcept { return m_ms <= 0; }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            m_timer.setSingleShot(true);
+            QObject::connect(&m_timer, &QTimer::timeout, &m_timer, [this, h] { detail::resumeLater(&m_timer, h); });
+            m_timer.start(m_ms);
+        }
+
+        void await_resume() const noexcept {}
+
+    private:
+        int m_ms;       ///< Длительность ожидания (мс).
+        QTimer m_timer; ///< Таймер продолжения.
+    };
+
+    /// Приостанавливает сопрограмму на @p ms миллисекунд.
+    inline Sleep sleep(int ms) { return Sleep(ms); }
+
+    /**
+     * @brief Ожидание фоновой задачи: @c co_await Coro::resultOf(QtConcurrent::run(...)).
+     *
+     * Сопрограмма продолжается в своём потоке, из цикла событий, когда
+     * задача закончится. При отмене наблюдатель разрушается вместе с
+     * объектом ожидания и продолжения не будет, а сама задача дорабатывает
+     * в пуле — поэтому ей передают копии данных, а не ссылки на них.
+     */
+    template<typename T>
+    class FutureResult {
+    public:
+        explicit FutureResult(QFuture<T> future) : m_future(std::move(future)) {}
+
+        bool await_ready() const { return m_future.isFinished(); }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            QObject::connect(&m_watcher, &QFutureWatcherBase::finished, &m_watcher,
+                             [this, h] { detail::resumeLater(&m_watcher, h); });
+            m_watcher.setFuture(m_future);
+        }
+
+        T await_resume() { return m_future.result(); }
+
+    private:
+        QFuture<T> m_future;         ///< Ожидаемая задача.
+        QFutureWatcher<T> m_watcher; ///< Сообщает о завершении задачи в поток сопрограммы.
+    };
+
+    /// Ожидает результат фоновой задачи @p future.
+    template<typename T>
+    FutureResult<T> resultOf(QFuture<T> future) { return FutureResult<T>(std::move(future)); }
+
+    /**
+     * @brief Периодические тики для циклов регулирования: @c co_await ticker.next().
+     *
+     * Тики идут от одного таймера без накопления ухода. Если тик пришёл,
+     * пока сопрограмма занята (ждёт обмена), следующий @ref next()
+     * завершается сразу; пропущенные сверх одного тики не копятся, как
+     * и у @c QTimer. Ждать тикер может одна сопрограмма одновременно.
+     */
+    class Ticker {
+    public:
+        class Next {
+        public:
+            explicit Next(Ticker *ticker) : m_ticker(ticker) {}
+            Next(const Next &) = delete;
+            Next &operator=(const Next &) = delete;
+
+            /// При отмене ожидающей сопрограммы тикер о ней забывает.
+            ~Next() {
+                if (m_ticker->m_waiter == this)
+                    m_ticker->m_waiter = nullptr;
+            }
+
+            bool await_ready() const noexcept { return std::exchange(m_ticker->m_pending, false); }
+
+            void await_suspend(std::coroutine_handle<> h) noexcept {
+                m_handle = h;
+                m_ticker->m_waiter = this;
+            }
+
+            void await_resume() const noexcept {}
+
+        private:
+            friend class Ticker;
+            Ticker *m_ticker;
+            std::coroutine_handle<> m_handle;
+        };
+
+        /// Запускает тики с периодом @p periodMs.
+        explicit Ticker(int periodMs) {
+            // ожидающий продолжается отложенно; если к тому моменту его отменили, тик копится
+            QObject::connect(&m_timer, &QTimer::timeout, &m_timer, [this] {
+                QMetaObject::invokeMethod(&m_timer, [this] { tick(); }, Qt::QueuedConnection);
+            });
+            m_timer.start(periodMs);
+        }
+        Ticker(const Ticker &) = delete;
+        Ticker &operator=(const Ticker &) = delete;
+
+        /// Ожидание следующего тика.
+        Next next() { return Next(this); }
+
+    private:
+        void tick() {
+            if (Next *waiter = std::exchange(m_waiter, nullptr))
+                waiter->m_handle.resume();
+            else
+                m_pending = true;
+        }
+
+        QTimer m_timer;             ///< Источник тиков.
+        Next *m_waiter = nullptr;   ///< Ожидающая сопрограмма.
+        bool m_pending = false;     ///< Тик пришёл без ожидающего.
+    };
+
+    /**
+     * @brief Взаимное исключение для сопрограмм одного потока.
+     *
+     * Нужна там, где несколько последовательностей делят один ресурс
+     * (линию связи): ожидающие ставятся в очередь и продолжаются по
+     * одному в порядке прихода. Следующий ожидающий продолжается из цикла
+     * событий, а не из освобождения: блокировка освобождается и при
+     * разрушении кадра отменённой сопрограммы, когда владелец ресурса
+     * может сам разрушаться. До передачи блокировка остаётся занятой,
+     * так что пришедшие позже не обгоняют очередь.
+     * @code
+     *   const Coro::Mutex::Lock lock = co_await mutex.lock();
+     * @endcode
+     */
+    class Mutex {
+    public:
+        /// Владение блокировкой; освобождается при разрушении.
+        class Lock {
+        public:
+            explicit Lock(Mutex *mutex) : m_mutex(mutex) {}
+            Lock(Lock &&other) noexcept : m_mutex(std::exchange(other.m_mutex, nullptr)) {}
+            Lock(const Lock &) = delete;
+            Lock &operator=(const Lock &) = delete;
+            Lock &operator=(Lock &&) = delete;
+
+            ~Lock() {
+                if (m_mutex)
+                    m_mutex->unlock();
+            }
+
+        private:
+            Mutex *m_mutex;
+        };
+
+        class Acquire {
+        public:
+            explicit Acquire(Mutex *mutex) : m_mutex(mutex) {}
+            Acquire(const Acquire &) = delete;
+            Acquire &operator=(const Acquire &) = delete;
+
+            /// Отменённый ожидающий покидает очередь.
+            ~Acquire() {
+                if (m_handle)
+                    m_mutex->m_waiters.removeOne(this);
+            }
+
+            bool await_ready() const noexcept {
+                if (m_mutex->m_locked)
+                    return false;
+                m_mutex->m_locked = true;
+                return true;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                m_handle = h;
+                m_mutex->m_waiters.append(this);
+            }
+
+            Lock await_resume() noexcept { return Lock(m_mutex); }
+
+        private:
+            friend class Mutex;
+            Mutex *m_mutex;
+            std::coroutine_handle<> m_handle; ///< Не пусто, пока стоит в очереди.
+        };
+
+        Mutex() = default;
+        Mutex(const Mutex &) = delete;
+        Mutex &operator=(const Mutex &) = delete;
+
+        /// Ожидание блокировки.
+        Acquire lock() { return Acquire(this); }
+
+        /// Занята ли блокировка.
+        bool isLocked() const { return m_locked; }
+
+    private:
+        /// Освобождает блокировку или откладывает её передачу первому ожидающему.
+        void unlock() {
+            if (m_waiters.isEmpty()) {
+                m_locked = false;
+                return;
+            }
+            QMetaObject::invokeMethod(&m_context, [this] { handOver(); }, Qt::QueuedConnection);
+        }
+
+        /// Продолжает первого ожидающего; если очередь к этому времени опустела — освобождает.
+        void handOver() {
+            if (m_waiters.isEmpty()) {
+                m_locked = false;
+                return;
+            }
+            Acquire *next = m_waiters.takeFirst();
+            std::exchange(next->m_handle, {}).resume();
+        }
+
+        bool m_locked = false;      ///< Блокировка занята.
+        QVector<Acquire *> m_waiters; ///< Очередь ожидающих.
+        QObject m_context;          ///< Владелец отложенной передачи (с мьютексом она отменяется).
+    };
+}
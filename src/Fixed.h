@@ -0,0 +1,107 @@
+/**
+ * @file Fixed.h
+ * @brief Величины с фиксированной точкой в единицах устройства.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief Величина с фиксированной точкой: целое число долей 1/Scale единицы.
+ *
+ * Сырые значения протокола (л/мин * 100, мм рт. ст. * 10, ...) хранятся
+ * как есть, сложение, вычитание и сравнения целочисленные, поэтому
+ * прогон на имитаторе и на стенде по одним и тем же отсчётам даёт
+ * один и тот же результат бит в бит. В @c double значение переводится
+ * только на границе с интерфейсом и статистикой (@ref toDouble()),
+ * из @c double — только при чтении конфигурации (@ref fromDouble()).
+ *
+ * @tparam Scale Число долей в единице (100 — сотые).
+ * @tparam Tag   Физическая величина: значения разных величин не смешиваются.
+ */
+template<int Scale, typename Tag>
+class Fixed {
+    static_assert(Scale > 0, "scale must be positive");
+
+public:
+    using Rep = int32_t;
+    static constexpr int scale = Scale;
+
+    constexpr Fixed() = default;
+
+    /// Из сырого значения (доли 1/Scale).
+    static constexpr Fixed fromRaw(Rep raw) {
+        Fixed f;
+        f.m_raw = raw;
+        return f;
+    }
+
+    /// Из целого числа единиц.
+    static constexpr Fixed fromUnits(int units) {
+        return fromRaw(units * Scale);
+    }
+
+    /// Из числа с плавающей точкой, с округлением до ближайшей доли.
+    static Fixed fromDouble(double value) {
+        return fromRaw(static_cast<Rep>(std::lround(value * Scale)));
+    }
+
+    /// Сырое значение.
+    constexpr Rep raw() const { return m_raw; }
+
+    /// Значение в единицах (только для интерфейса, статистики и экспорта).
+    constexpr double toDouble() const { return static_cast<double>(m_raw) / Scale; }
+
+    /// Та же величина в другом масштабе, с округлением до ближайшей доли.
+    template<int OtherScale>
+    constexpr Fixed<OtherScale, Tag> rescale() const {
+        const int64_t num = static_cast<int64_t>(m_raw) * OtherScale;
+        const int64_t half = m_raw < 0 ? -Scale / 2 : Scale / 2;
+        return Fixed<OtherScale, Tag>::fromRaw(static_cast<Rep>((num + half) / Scale));
+    }
+
+    constexpr Fixed abs() const { return fromRaw(m_raw < 0 ? -m_raw : m_raw); }
+
+    constexpr Fixed operator-() const { return fromRaw(-m_raw); }
+    constexpr Fixed &operator+=(Fixed other) { m_raw += other.m_raw; return *this; }
+    constexpr Fixed &operator-=(Fixed other) { m_raw -= other.m_raw; return *this; }
+
+    friend constexpr Fixed operator+(Fixed a, Fixed b) { return fromRaw(a.m_raw + b.m_raw); }
+    friend constexpr Fixed operator-(Fixed a, Fixed b) { return fromRaw(a.m_raw - b.m_raw); }
+    friend constexpr Fixed operator*(Fixed a, int k) { return fromRaw(a.m_raw * k); }
+    friend constexpr Fixed operator*(int k, Fixed a) { return fromRaw(a.m_raw * k); }
+
+    friend constexpr bool operator==(Fixed a, Fixed b) { return a.m_raw == b.m_raw; }
+    friend constexpr bool operator!=(Fixed a, Fixed b) { return a.m_raw != b.m_raw; }
+    friend constexpr bool operator<(Fixed a, Fixed b) { return a.m_raw < b.m_raw; }
+    friend constexpr bool operator<=(Fixed a, Fixed b) { return a.m_raw <= b.m_raw; }
+    friend constexpr bool operator>(Fixed a, Fixed b) { return a.m_raw > b.m_raw; }
+    friend constexpr bool operator>=(Fixed a, Fixed b) { return a.m_raw >= b.m_raw; }
+
+private:
+    Rep m_raw = 0; ///< Количество долей 1/Scale.
+};
+
+/// @c true для типов @ref Fixed.
+template<typename T>
+struct IsFixed : std::false_type {};
+
+template<int Scale, typename Tag>
+struct IsFixed<Fixed<Scale, Tag>> : std::true_type {};
+
+/**
+ * @brief Величины в масштабе, в котором их передаёт устройство.
+ */
+namespace Units {
+    struct FlowTag;
+    struct PressureTag;
+    struct TemperatureTag;
+
+    using Flow = Fixed<100, FlowTag>;              ///< Расход, л/мин с шагом 0.01.
+    using FlowTenths = Fixed<10, FlowTag>;         ///< Расход, л/мин с шагом 0.1.
+    using Pressure = Fixed<10, PressureTag>;       ///< Давление, мм рт. ст. с шагом 0.1.
+    using Temperature = Fixed<2, TemperatureTag>;  ///< Температура, °C с шагом 0.5.
+}
@@ -5,7 +5,11 @@
 
 #pragma once
 
+#include <limits>
+
 #include "orders.h"
+#include "PollScheduler.h"
+#include "PlantModel.h"
 
 /**
  * @brief Реализует алгоритм управления клапаном для калибровки по расходу.
@@ -14,28 +18,53 @@
  * с устройством и выполняет простой замкнутый контур регулирования,
  * стремящийся достигнуть заданного значения расхода @c SETTING.
  * Снаружи доступны текущий расход, PWM и ошибка регулирования.
+ *
+ * Обмен с устройством выполняют сопрограммы (@ref start(), @ref tick(),
+ * @ref stop()). Деструктор команд не отправляет: подачу до разрушения
+ * алгоритма отключает @ref stop() с подтверждением устройства.
  */
 class Insufflator {
     const bool IS_CO2 = true;   ///< Режим CO₂ для измерения расхода.
     Data *mydata;               ///< Общий объект транспорта данных (протокол устройства).
     int delay;                  ///< Счётчик тиков между сменой состояний (открыт/закрыт).
     int PULSE_TIME = 20;        ///< Длительность импульса открытия клапана (в тиках).
-    double SETTING;             ///< Целевое значение расхода (уставка).
+    Units::Flow SETTING;        ///< Целевое значение расхода (уставка).
     int PWM_INIT = 2900;        ///< Начальное значение PWM при запуске алгоритма.
     int PAUSE = 4;              ///< Пауза между импульсами (в тиках).
+    double GAIN = 10;           ///< Поправка PWM на 1 л/мин ошибки расхода.
     bool is_valve_on = true;    ///< Текущее состояние клапана (открыт/закрыт).
+    PollScheduler scheduler;    ///< Планировщик опроса измерительных каналов.
+    PollScheduler::ChannelId<Units::Flow> flowChannel;            ///< Канал измеренного расхода.
+    PollScheduler::ChannelId<Units::Pressure> presChannel;        ///< Канал измеренного давления инсуффляции.
+    PollScheduler::ChannelId<Units::Pressure> rdcPresChannel;     ///< Канал вычисленного давления редуктора.
+    PollScheduler::ChannelId<Units::Temperature> tempChannel;     ///< Канал температуры.
+    std::vector<PlantModel::Sample> history; ///< Запись тиков для идентификации клапана.
 
 public :
-    double currentFlow;         ///< Последнее измеренное значение расхода (л/мин).
-    short pwm;                  ///< Текущее значение PWM, отправленное на клапан.
-    double error = 99;          ///< Текущая ошибка регулирования (расход - уставка).
+    /// Период тика алгоритма (мс); с этим периодом Controller ожидает @ref algorithms().
+    static constexpr int TICK_MS = 100;
+    /// Пауза после перехода в сервисный режим (мс).
+    static constexpr int SERVICE_MODE_MS = 2000;
+    /// Доля тика, которую планировщик может занять опросом каналов (мс).
+    static constexpr int POLL_BUDGET_MS = TICK_MS * 6 / 10;
+    /// Частота опроса расхода (Гц): чаще тика, планировщик опрашивает его внутри окна.
+    static constexpr double FLOW_RATE_HZ = 20;
+
+    Units::Flow currentFlow;          ///< Последнее измеренное значение расхода.
+    Units::Pressure pressure;         ///< Измеренное давление инсуффляции.
+    Units::Pressure reducerPressure;  ///< Вычисленное давление редуктора.
+    Units::Temperature temperature;   ///< Температура корпуса.
+    short pwm;                        ///< Текущее значение PWM, отправленное на клапан.
+    Units::Flow error = Units::Flow::fromUnits(99); ///< Текущая ошибка регулирования (расход - уставка).
+    int pulses = 0;             ///< Количество завершённых импульсов (пересчётов PWM).
 
     /**
      * @brief Результат линейной аппроксимации (PWM = slope * flow + offset).
      */
     struct result {
-        double slope; ///< Approximation slope.
-        int offset;   ///< Approximation offset.
+        double slope = 0.0; ///< Approximation slope.
+        int offset = 0;     ///< Approximation offset.
+        bool ok = false;    ///< Точки задают прямую с ненулевым наклоном.
     };
 
     /**
@@ -48,118 +77,239 @@ public :
         double FLOW2 = 0.0;
     };
 
+    /**
+     * @brief Калибровочная точка: PWM, при котором достигнут расход.
+     */
+    struct Point {
+        int pwm;
+        Units::Flow flow;
+    };
+
     /**
      * @brief Конструктор алгоритма с заданным транспортом и уставкой расхода.
      * @param dataPtr Указатель на общий объект @ref Data.
      * @param setting Желаемое значение расхода.
+     * @param tuning  Усиление регулятора и длительности импульса/паузы.
+     * @param initialPwm Начальный PWM (например, прогноз по уже снятым точкам);
+     *                   отрицательное значение — @c PWM_INIT.
+     *
+     * Устройство готовится к регулированию отдельно, сопрограммой @ref start().
      *
-     * В конструкторе выполняется начальная последовательность команд:
-     * переход в сервисный режим, установка давления, включение подачи газа.
-     * После этого устройство готово к регулированию расхода.
+     * Расход опрашивается с наивысшим приоритетом и частотой
+     * @ref FLOW_RATE_HZ, давления — с частотой 2 Гц, температура — 1 Гц.
      */
-    Insufflator(Data *dataPtr, double setting) : mydata(dataPtr), SETTING(setting) {
-        Data::DataNode node;
-        pwm = PWM_INIT;
+    Insufflator(Data *dataPtr, Units::Flow setting, const PlantModel::Tuning &tuning = PlantModel::Tuning{},
+                int initialPwm = -1)
+        : mydata(dataPtr), SETTING(setting), scheduler(dataPtr) {
+        PULSE_TIME = tuning.pulseTime;
+        PAUSE = tuning.pause;
+        GAIN = tuning.pwmPerFlow;
+        pwm = initialPwm < 0 ? PWM_INIT : qBound(0, initialPwm, 4000);
         delay = PAUSE;
         PULSE_TIME -= PAUSE;
-        mydata->SendData(KEYS::ADDRESS, KEYS::KEY_SIG, INSUF::KEY_SERVICE_SIG);
-        do mydata->RecieveData(&node);
-        while (node.tag != KEYS::KEY_SIG);
-        QThread::msleep(2000);
-        mydata->SendData(REGUL::ADDRESS, REGUL::SET_PRES, 30);
-        do mydata->RecieveData(&node);
-        while (node.tag != REGUL::SET_PRES);
-        mydata->SendData(REDUC::ADDRESS, REDUC::ON_FLOW, 0);
-        do mydata->RecieveData(&node);
-        while (node.tag != REDUC::ON_FLOW);
+
+        flowChannel = scheduler.addChannel<Protocol::GetMsrFlow>("FLOW", IS_CO2, FLOW_RATE_HZ, 3);
+        presChannel = scheduler.addChannel<Protocol::GetMsrPres>("PRES", 0, 2, 2);
+        rdcPresChannel = scheduler.addChannel<Protocol::GetRdcPres>("RDC_PRES", 0, 2, 1);
+        tempChannel = scheduler.addChannel<Protocol::GetTemperature>("TEMP", 0, 1, 0);
     }
 
     /**
-     * @brief Деструктор отправляет команды для безопасного отключения потока.
+     * @brief Начальная последовательность: сервисный режим, давление, подача газа.
+     * @return @c false, если устройство не ответило в срок или сработала критическая тревога.
      */
-    ~Insufflator() {
-        Data::DataNode node;
-        mydata->SendData(REDUC::ADDRESS, REDUC::SHUT_OFF, 0);
-        do mydata->RecieveData(&node);
-        while (node.tag != REDUC::SHUT_OFF);
-        mydata->SendData(REDUC::ADDRESS, REDUC::OFF_FLOW, 0);
-        do mydata->RecieveData(&node);
-        while (node.tag != REDUC::OFF_FLOW);
+    Coro::Task<bool> start() {
+        // при критической тревоге газ уже перекрыт, подачу не включаем
+        const bool service = co_await mydata->asyncRequest<Protocol::KeySig>(INSUF::KEY_SERVICE_SIG);
+        if (!service) co_return false;
+        co_await Coro::sleep(SERVICE_MODE_MS);
+        const bool pressure = co_await mydata->asyncRequest<Protocol::SetPres>(30);
+        if (!pressure) co_return false;
+        co_return co_await mydata->asyncRequest<Protocol::OnFlow>();
     }
 
     /**
-     * @brief Запрашивает у устройства текущее значение расхода.
-     * @return Структура DataNode с «сырым» и приведённым значением расхода.
+     * @brief Безопасно отключает поток: закрывает клапан и выключает подачу газа.
+     *
+     * Команды идут через @ref Data::asyncSafetyRequest(): и после
+     * критической тревоги, с ожиданием подтверждения и повтором.
+     * @return @c true, если устройство подтвердило обе команды.
      */
-    Data::DataNode getFlow(void) {
-        Data::DataNode node;
-        mydata->SendData(REGUL::ADDRESS, REGUL::GET_MSR_FLOW, IS_CO2, 0);
-        do mydata->RecieveData(&node);
-        while (node.tag != REGUL::GET_MSR_FLOW);
-        UART::logUARTData("FLOW", node.data);
-        node.data /= 100;
-        return node;
+    Coro::Task<bool> stop() {
+        const bool closed = co_await mydata->asyncSafetyRequest<Protocol::ShutOff>();
+        const bool off = co_await mydata->asyncSafetyRequest<Protocol::OffFlow>();
+        co_return closed && off;
     }
 
     /**
-     * @brief Один шаг алгоритма: измерение расхода и обновление состояния клапана.
+     * @brief Запрашивает у устройства текущее значение расхода вне планировщика.
+     * @return Расход (0, если ответа нет в срок или ожидание прервано тревогой).
      */
-    void tick() {
-        currentFlow = getFlow().data;
+    Coro::Task<Units::Flow> getFlow(void) {
+        Units::Flow flow;
+        co_await mydata->asyncRequest<Protocol::GetMsrFlow>(IS_CO2, &flow);
+        co_return flow;
+    }
+
+    /**
+     * @brief Один шаг алгоритма: опрос каналов и обновление состояния клапана.
+     */
+    Coro::Task<> tick() {
+        if (mydata->alarm()) co_return;
+        co_await scheduler.poll(POLL_BUDGET_MS);
+        currentFlow = scheduler.value(flowChannel);
+        pressure = scheduler.value(presChannel);
+        reducerPressure = scheduler.value(rdcPresChannel);
+        temperature = scheduler.value(tempChannel);
+        if (mydata->alarm()) co_return;
         if (!(--delay)) {
-            if (is_valve_on) { offPulse(); } else onPulse();
+            if (is_valve_on) { co_await offPulse(); } else co_await onPulse();
         }
+        history.push_back({is_valve_on, pwm, currentFlow});
     }
 
     /**
      * @brief Открывает клапан и запланирует следующую паузу.
      */
-    void onPulse() {
+    Coro::Task<> onPulse() {
         is_valve_on = true;
-        Data::DataNode node;
-        mydata->SendData(REDUC::ADDRESS, REDUC::SET_SHIM, pwm);
-        do mydata->RecieveData(&node);
-        while (node.tag != REDUC::SET_SHIM);
+        co_await mydata->asyncRequest<Protocol::SetShim>(pwm);
         delay = PULSE_TIME;
     }
 
     /**
      * @brief Закрывает клапан, пересчитывает PWM по ошибке и запускает паузу.
      */
-    void offPulse() {
+    Coro::Task<> offPulse() {
         is_valve_on = false;
-        Data::DataNode node;
         error = currentFlow - SETTING;
-        pwm += 10 * error;
-        if (pwm < 0) pwm = 0;
-        if (pwm > 4000) pwm = 4000;
-        mydata->SendData(REDUC::ADDRESS, REDUC::SHUT_OFF, 0);
-        do mydata->RecieveData(&node);
-        while (node.tag != REDUC::SHUT_OFF);
+        ++pulses;
+        // поправка округляется до целого PWM и зависит только от сырых отсчётов
+        pwm = qBound(0, pwm + static_cast<int>(std::lround(GAIN * error.raw() / Units::Flow::scale)), 4000);
+        co_await mydata->asyncRequest<Protocol::ShutOff>();
         delay = PAUSE;
     }
 
     /**
      * @brief Публичная точка входа для продвижения состояния алгоритма.
      *
-     * На данный момент просто вызывает @ref tick(), но оставлена как
+     * На данный момент просто выполняет @ref tick(), но оставлена как
      * отдельный метод для возможного усложнения логики.
      */
-    void algorithms() {
-        tick();
+    Coro::Task<> algorithms() {
+        return tick();
+    }
+
+    /// Открыт ли сейчас клапан.
+    bool valveOn() const {
+        return is_valve_on;
+    }
+
+    /// Запись тиков (клапан, PWM, расход) с момента создания, для @ref PlantModel.
+    const std::vector<PlantModel::Sample> &trace() const {
+        return history;
+    }
+
+    /// Включает или выключает запись каждого измерения расхода в текстовый лог.
+    void setFlowLogged(bool logged) {
+        scheduler.setLogged(flowChannel, logged);
+    }
+
+    /// Назначает обработчик каждого измерения расхода: с частотой @ref FLOW_RATE_HZ, а не раз за тик.
+    void onFlowSample(std::function<void(Units::Flow)> handler) {
+        scheduler.onSample(flowChannel, std::move(handler));
+    }
+
+    /// Доля времени, в течение которого линия занята опросом каналов (0..1).
+    double linkUtilisation() const {
+        return scheduler.utilisation();
+    }
+
+    /// Сводка планировщика опроса: фактические частоты каналов и загрузка линии.
+    QString pollingReport() const {
+        return scheduler.report();
     }
 
     /**
      * @brief Вычисляет параметры линейной аппроксимации по двум точкам.
      *
      * @param in_value Заполненная структура @ref INValue с двумя точками.
-     * @return Структура с рассчитанными наклоном и смещением.
+     * @return Структура с рассчитанными наклоном и смещением; @c ok = @c false,
+     *         если расходы точек совпадают или PWM не меняется.
      */
     static result approximate(const INValue &in_value) {
         result res;
+        if (in_value.FLOW2 == in_value.FLOW1 || in_value.PWM1 == in_value.PWM2)
+            return res;
         double slope = (in_value.PWM1 - in_value.PWM2) / (in_value.FLOW2 - in_value.FLOW1);
         res.slope = round(slope * 100) / 100;
         res.offset = in_value.PWM1 + in_value.FLOW1 * res.slope - 800;
+        res.ok = true;
         return res;
     }
+
+    /**
+     * @brief Аппроксимация по N точкам методом наименьших квадратов.
+     *
+     * Подбирает прямую PWM = -slope * flow + b; смещение считается так же,
+     * как в двухточечном варианте, но через центр масс точек.
+     *
+     * @param points Не менее двух точек с различным расходом.
+     * @param rms    Куда записать СКО точек от прямой по расходу (может быть @c nullptr);
+     *               бесконечность, если прямая не определена.
+     * @return Структура с рассчитанными наклоном и смещением; @c ok = @c false,
+     *         если точек меньше двух, все расходы совпадают или PWM от расхода
+     *         не зависит (наклон нулевой).
+     */
+    static result approximate(const QVector<Point> &points, double *rms = nullptr) {
+        const int n = points.size();
+        if (rms)
+            *rms = std::numeric_limits<double>::infinity();
+        if (n < 2)
+            return result{};
+
+        double meanFlow = 0, meanPwm = 0;
+        for (const Point &p: points) {
+            meanFlow += p.flow.toDouble();
+            meanPwm += p.pwm;
+        }
+        meanFlow /= n;
+        meanPwm /= n;
+
+        double sxx = 0, sxy = 0;
+        for (const Point &p: points) {
+            const double flow = p.flow.toDouble();
+            sxx += (flow - meanFlow) * (flow - meanFlow);
+            sxy += (flow - meanFlow) * (p.pwm - meanPwm);
+        }
+        if (sxx == 0 || sxy == 0)
+            return result{};
+        const double slope = -sxy / sxx;
+
+        if (rms) {
+            double sse = 0;
+            for (const Point &p: points) {
+                const double e = p.flow.toDouble() - (meanFlow - (p.pwm - meanPwm) / slope);
+                sse += e * e;
+            }
+            *rms = std::sqrt(sse / n);
+        }
+
+        result res;
+        res.slope = round(slope * 100) / 100;
+        res.offset = meanPwm + meanFlow * res.slope - 800;
+        res.ok = true;
+        return res;
+    }
+
+    /**
+     * @brief Прогнозирует PWM для расхода по уже снятым точкам.
+     * @return Прогноз или -1, если по точкам прямая не определена.
+     */
+    static int predictPwm(const QVector<Point> &points, Units::Flow flow) {
+        const result res = approximate(points);
+        if (!res.ok)
+            return -1;
+        return qRound(res.offset + 800 - flow.toDouble() * res.slope);
+    }
 };
@@ -0,0 +1,181 @@
+/**
+ * @file Metrics.h
+ * @brief Счётчики, показатели и гистограммы тюнера в формате Prometheus.
+ */
+
+#pragma once
+
+#include <QByteArray>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Дописывает строки HELP/TYPE метрики в текстовый формат Prometheus.
+inline void metricHeader(QByteArray &out, const char *name, const char *help, const char *type) {
+    out.append("# HELP ").append(name).append(' ').append(help).append('\n');
+    out.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+/**
+ * @brief Монотонный счётчик.
+ */
+class Counter {
+public:
+    void inc(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+/**
+ * @brief Мгновенное значение.
+ */
+class Gauge {
+public:
+    void set(double v) { m_value.store(v, std::memory_order_relaxed); }
+    double value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> m_value{0.0};
+};
+
+/**
+ * @brief Гистограмма с фиксированными границами корзин.
+ *
+ * Границы задаются на этапе компиляции, поэтому @ref observe() не
+ * выделяет память и сводится к поиску корзины и атомарным инкрементам.
+ *
+ * @tparam N Количество конечных границ (плюс корзина +Inf).
+ */
+template<size_t N>
+class Histogram {
+public:
+    explicit constexpr Histogram(const double (&bounds)[N]) : m_bounds(bounds) {}
+
+    void observe(double v) {
+        size_t i = 0;
+        while (i < N && v > m_bounds[i])
+            ++i;
+        m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        double sum = m_sum.load(std::memory_order_relaxed);
+        while (!m_sum.compare_exchange_weak(sum, sum + v, std::memory_order_relaxed)) {}
+    }
+
+    /// Количество наблюдений.
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    /// Сумма наблюдений.
+    double sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    /// Дописывает гистограмму в текстовый формат Prometheus.
+    void render(QByteArray &out, const char *name, const char *help) const {
+        metricHeader(out, name, help, "histogram");
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= N; ++i) {
+            cumulative += m_buckets[i].load(std::memory_order_relaxed);
+            out.append(name).append("_bucket{le=\"");
+            if (i < N)
+                out.append(QByteArray::number(m_bounds[i], 'g', 6));
+            else
+                out.append("+Inf");
+            out.append("\"} ").append(QByteArray::number(cumulative)).append('\n');
+        }
+        out.append(name).append("_sum ")
+           .append(QByteArray::number(m_sum.load(std::memory_order_relaxed), 'g', 10)).append('\n');
+        out.append(name).append("_count ")
+           .append(QByteArray::number(m_count.load(std::memory_order_relaxed))).append('\n');
+    }
+
+private:
+    const double (&m_bounds)[N];
+    std::atomic<uint64_t> m_buckets[N + 1] = {};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<double> m_sum{0.0};
+};
+
+/**
+ * @brief Все метрики тюнера.
+ *
+ * Единственный экземпляр доступен через @ref metrics(). Запись значений
+ * не выделяет память; текст для Prometheus собирается только в
+ * @ref render(), т.е. при опросе.
+ */
+struct Metrics {
+    static constexpr double RTT_BOUNDS[] = {0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0};
+    static constexpr double PULSE_BOUNDS[] = {1, 2, 3, 5, 8, 13, 21, 34, 55};
+    static constexpr double PHASE_BOUNDS[] = {2, 5, 10, 20, 30, 60, 120, 300};
+    static constexpr double RUN_BOUNDS[] = {10, 20, 30, 60, 120, 300, 600, 1200};
+
+    Counter calibrationsOk;       ///< Успешно завершённые калибровки.
+    Counter calibrationsFailed;   ///< Калибровки, не набравшие точек.
+    Counter calibrationsAborted;  ///< Калибровки, прерванные тревогой.
+    Counter setpointTimeouts;     ///< Уставки, не достигнутые за отведённое время.
+    Counter portErrors;           ///< Ошибки порта: не открылся или не ответил вовремя.
+    Counter alarms;               ///< Принятые кадры тревог.
+    Counter frames;               ///< Принятые кадры (ответы и незапрошенные).
+    Counter badFrames;            ///< Отброшенные кадры: неверное экранирование, длина или CRC.
+
+    Gauge running;                ///< 1, если идёт настройка.
+    Gauge flow;                   ///< Последний расход, л/мин.
+    Gauge pwm;                    ///< Последний PWM.
+    Gauge linkUtilisation;        ///< Загрузка линии планировщиком опроса (0..1).
+
+    Histogram<9> rttSeconds{RTT_BOUNDS};           ///< Время «запрос-ответ».
+    Histogram<9> pulsesToConverge{PULSE_BOUNDS};   ///< Импульсов до достижения уставки.
+    Histogram<8> phaseSeconds{PHASE_BOUNDS};       ///< Длительность уставки.
+    Histogram<8> calibrationSeconds{RUN_BOUNDS};   ///< Длительность всей калибровки.
+
+    /// Формирует ответ в текстовом формате Prometheus 0.0.4.
+    QByteArray render() const {
+        QByteArray out;
+        out.reserve(4096);
+
+        metricHeader(out, "valve_tuner_calibrations_total", "Finished calibration runs by result.", "counter");
+        counter(out, "valve_tuner_calibrations_total{result=\"ok\"}", calibrationsOk);
+        counter(out, "valve_tuner_calibrations_total{result=\"failed\"}", calibrationsFailed);
+        counter(out, "valve_tuner_calibrations_total{result=\"aborted\"}", calibrationsAborted);
+
+        metricHeader(out, "valve_tuner_setpoint_timeouts_total", "Setpoints not reached before their timeout.", "counter");
+        counter(out, "valve_tuner_setpoint_timeouts_total", setpointTimeouts);
+        metricHeader(out, "valve_tuner_port_errors_total", "Port open failures and receive timeouts.", "counter");
+        counter(out, "valve_tuner_port_errors_total", portErrors);
+        metricHeader(out, "valve_tuner_alarms_total", "Alarm frames received from the device.", "counter");
+        counter(out, "valve_tuner_alarms_total", alarms);
+        metricHeader(out, "valve_tuner_frames_total", "Frames received from the device.", "counter");
+        counter(out, "valve_tuner_frames_total", frames);
+        metricHeader(out, "valve_tuner_bad_frames_total", "Frames dropped for bad escaping, length or CRC.", "counter");
+        counter(out, "valve_tuner_bad_frames_total", badFrames);
+
+        metricHeader(out, "valve_tuner_running", "1 while a calibration is running.", "gauge");
+        gauge(out, "valve_tuner_running", running);
+        metricHeader(out, "valve_tuner_flow_lpm", "Last measured flow, L/min.", "gauge");
+        gauge(out, "valve_tuner_flow_lpm", flow);
+        metricHeader(out, "valve_tuner_pwm", "Last valve PWM.", "gauge");
+        gauge(out, "valve_tuner_pwm", pwm);
+        metricHeader(out, "valve_tuner_link_utilisation", "Fraction of time the serial link is busy polling.", "gauge");
+        gauge(out, "valve_tuner_link_utilisation", linkUtilisation);
+
+        rttSeconds.render(out, "valve_tuner_rtt_seconds", "Request to reply round-trip time.");
+        pulsesToConverge.render(out, "valve_tuner_pulses_to_converge", "Valve pulses needed to reach a setpoint.");
+        phaseSeconds.render(out, "valve_tuner_phase_duration_seconds", "Time spent on one setpoint.");
+        calibrationSeconds.render(out, "valve_tuner_calibration_duration_seconds", "Duration of a full calibration run.");
+        return out;
+    }
+
+private:
+    static void counter(QByteArray &out, const char *series, const Counter &c) {
+        out.append(series).append(' ').append(QByteArray::number(c.value())).append('\n');
+    }
+
+    static void gauge(QByteArray &out, const char *series, const Gauge &g) {
+        out.append(series).append(' ').append(QByteArray::number(g.value(), 'g', 10)).append('\n');
+    }
+};
+
+/// Общий экземпляр метрик приложения.
+inline Metrics &metrics() {
+    static Metrics instance;
+    return instance;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file MetricsServer.h
+ * @brief Минимальный HTTP-сервер на loopback для опроса метрик Prometheus.
+ */
+
+#pragma once
+
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "Metrics.h"
+
+/**
+ * @brief Отдаёт @ref metrics() по запросу @c GET /metrics.
+ *
+ * Сервер слушает только 127.0.0.1 и включается явно (см. @ref main.cpp),
+ * работает в потоке GUI на событиях Qt и не касается пути измерений:
+ * текст метрик формируется только в момент запроса. Каждое соединение
+ * обслуживается одним ответом и закрывается.
+ *
+ * Проверка: @c curl http://127.0.0.1:<port>/metrics
+ */
+class MetricsServer {
+public:
+    /**
+     * @brief Начинает слушать порт на loopback-интерфейсе.
+     * @param port TCP-порт.
+     * @return @c false, если порт занят или недоступен.
+     */
+    bool listen(quint16 port) {
+        QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this]() {
+            while (QTcpSocket *socket = m_server.nextPendingConnection())
+                serve(socket);
+        });
+        return m_server.listen(QHostAddress::LocalHost, port);
+    }
+
+    /// Текст последней ошибки сервера.
+    QString errorString() const { return m_server.errorString(); }
+
+    /// Порт, который слушает сервер (нужен, если @ref listen() вызван с портом 0).
+    quint16 serverPort() const { return m_server.serverPort(); }
+
+    /**
+     * @brief Запрашивает ли строка запроса метрики.
+     *
+     * Параметры запроса (@c ?name[]=...) и фрагмент Prometheus и
+     * браузеры вправе добавить к пути — они отбрасываются.
+     * @param requestLine Первая строка HTTP-запроса без CRLF.
+     */
+    static bool isMetricsRequest(const QByteArray &requestLine) {
+        const QList<QByteArray> parts = requestLine.split(' ');
+        if (parts.size() < 2 || parts[0] != "GET")
+            return false;
+
+        QByteArray path = parts[1];
+        for (const char delimiter: {'?', '#'}) {
+            const int end = path.indexOf(delimiter);
+            if (end >= 0)
+                path.truncate(end);
+        }
+        return path == "/metrics";
+    }
+
+private:
+    static void serve(QTcpSocket *socket) {
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+            // запрос целиком помещается в один-два сегмента; ждём конца заголовков
+            if (!socket->peek(8192).contains("\r\n\r\n")) {
+                if (socket->bytesAvailable() > 8192)
+                    socket->abort();
+                return;
+            }
+
+            const QByteArray requestLine = socket->readLine().trimmed();
+            socket->readAll();
+
+            QByteArray body;
+            QByteArray status;
+            if (isMetricsRequest(requestLine)) {
+                status = "200 OK";
+                body = metrics().render();
+            } else {
+                status = "404 Not Found";
+                body = "not found\n";
+            }
+
+            QByteArray response;
+            response.append("HTTP/1.1 ").append(status).append("\r\n");
+            response.append("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n");
+            response.append("Content-Length: ").append(QByteArray::number(body.size())).append("\r\n");
+            response.append("Connection: close\r\n\r\n");
+            response.append(body);
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+    }
+
+    QTcpServer m_server; ///< Слушающий сокет.
+};
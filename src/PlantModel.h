@@ -0,0 +1,206 @@
+/**
+ * @file PlantModel.h
+ * @brief Идентификация динамики клапана по записанному отклику на импульсы.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "Fixed.h"
+
+/**
+ * @brief Модель клапана первого порядка с запаздыванием (ARX) и расчёт настроек.
+ *
+ * По последовательности тиков (состояние клапана, PWM, расход) подбирается
+ * модель
+ * @code
+ *   flow[k+1] = a * flow[k] + b * u[k-d] + c * on[k-d],   u = on ? pwm : 0
+ * @endcode
+ * методом наименьших квадратов; запаздывание @c d перебирается, берётся
+ * вариант с наименьшей невязкой. Записи разных фаз (уставок) не
+ * склеиваются: уравнения строятся только внутри фазы, а модель — одна
+ * на все фазы. Из модели получаются коэффициент
+ * передачи PWM → установившийся расход, постоянная времени и
+ * запаздывание, а из них — усиление регулятора и длительности импульса
+ * и паузы (@ref Tuning), при которых уставка достигается за минимальное
+ * число импульсов.
+ */
+class PlantModel {
+public:
+    /**
+     * @brief Один тик записи: состояние клапана на интервале после измерения.
+     */
+    struct Sample {
+        bool valveOn; ///< Клапан открыт на интервале [k, k+1).
+        int pwm;      ///< PWM, действующий на этом интервале.
+        Units::Flow flow; ///< Расход, измеренный в начале тика k.
+    };
+
+    /// Запись тиков одной фазы.
+    using Trace = std::vector<Sample>;
+
+    /**
+     * @brief Результат идентификации.
+     */
+    struct Fit {
+        bool ok = false;       ///< Модель устойчива и физически осмысленна.
+        double a = 0.0;        ///< Коэффициент авторегрессии.
+        double b = 0.0;        ///< Вклад PWM.
+        double c = 0.0;        ///< Вклад факта открытия клапана.
+        int deadTicks = 0;     ///< Запаздывание (тики).
+        double tauTicks = 0.0; ///< Постоянная времени (тики).
+        double gain = 0.0;     ///< d(установившийся расход) / d(PWM), л/мин на единицу PWM.
+        double rms = 0.0;      ///< Среднеквадратичная невязка (л/мин).
+    };
+
+    /**
+     * @brief Параметры регулятора @ref Insufflator.
+     */
+    struct Tuning {
+        double pwmPerFlow = 10.0; ///< Поправка PWM на 1 л/мин ошибки.
+        int pulseTime = 20;       ///< Период «импульс + пауза» (тики).
+        int pause = 4;            ///< Пауза между импульсами (тики).
+    };
+
+    /**
+     * @brief Подбирает модель по записи одной фазы.
+     * @param trace    Последовательность тиков одного или нескольких импульсов.
+     * @param maxDead  Наибольшее проверяемое запаздывание (тики).
+     */
+    static Fit identify(const Trace &trace, int maxDead = 5) {
+        return identify(std::vector<Trace>{trace}, maxDead);
+    }
+
+    /**
+     * @brief Подбирает одну модель по записям нескольких фаз.
+     *
+     * Регрессоры не переходят через границу фаз: первые @c d тиков
+     * каждой фазы служат только историей для запаздывающего входа, а
+     * последний тик фазы — только откликом. Переход расхода между
+     * уставками в модель не попадает.
+     * @param phases   Записи фаз в порядке обхода.
+     * @param maxDead  Наибольшее проверяемое запаздывание (тики).
+     */
+    static Fit identify(const std::vector<Trace> &phases, int maxDead = 5) {
+        Fit best;
+        double bestSse = -1;
+
+        for (int d = 0; d <= maxDead; ++d) {
+            // нормальные уравнения для [a, b, c]
+            double m[3][4] = {};
+            int n = 0;
+            for (const Trace &trace: phases)
+                forEachRow(trace, d, [&](const double (&x)[3], double y) {
+                    for (int i = 0; i < 3; ++i) {
+                        for (int j = 0; j < 3; ++j)
+                            m[i][j] += x[i] * x[j];
+                        m[i][3] += x[i] * y;
+                    }
+                    ++n;
+                });
+
+            double p[3];
+            if (n < 6 || !solve(m, p))
+                continue;
+
+            double sse = 0;
+            for (const Trace &trace: phases)
+                forEachRow(trace, d, [&](const double (&x)[3], double y) {
+                    const double e = y - (p[0] * x[0] + p[1] * x[1] + p[2] * x[2]);
+                    sse += e * e;
+                });
+
+            if (bestSse < 0 || sse < bestSse) {
+                bestSse = sse;
+                best.a = p[0];
+                best.b = p[1];
+                best.c = p[2];
+                best.deadTicks = d;
+                best.rms = std::sqrt(sse / n);
+            }
+        }
+
+        if (bestSse < 0 || best.a <= 0.0 || best.a >= 1.0)
+            return best;
+
+        best.tauTicks = -1.0 / std::log(best.a);
+        best.gain = best.b / (1.0 - best.a);
+        // больший PWM должен уменьшать расход
+        best.ok = best.gain < 0.0;
+        return best;
+    }
+
+    /**
+     * @brief Рассчитывает настройки регулятора по модели.
+     *
+     * Длительность открытия — запаздывание плюс три постоянные времени
+     * (расход успевает установиться с точностью ~5 %, и измерение перед
+     * закрытием отражает PWM этого импульса). Пауза — запаздывание плюс
+     * один тик. Усиление — 0.8 от «одношагового» 1/|gain|, чтобы ошибка
+     * модели не приводила к перерегулированию.
+     *
+     * @param fit      Результат @ref identify().
+     * @param fallback Текущие настройки; возвращаются при неудачной идентификации.
+     */
+    static Tuning tune(const Fit &fit, const Tuning &fallback) {
+        if (!fit.ok)
+            return fallback;
+
+        Tuning t;
+        const int onTicks = clamp(fit.deadTicks + static_cast<int>(std::ceil(3.0 * fit.tauTicks)) + 1, 3, 40);
+        t.pause = clamp(fit.deadTicks + 1, 1, 10);
+        t.pulseTime = onTicks + t.pause;
+        t.pwmPerFlow = 0.8 / -fit.gain;
+        return t;
+    }
+
+private:
+    /**
+     * @brief Перебирает уравнения модели внутри одной фазы.
+     *
+     * Для каждого тика @c k вызывает @p f с регрессорами
+     * [flow[k], u[k-d], on[k-d]] и откликом flow[k+1].
+     */
+    template<typename F>
+    static void forEachRow(const Trace &trace, int d, F &&f) {
+        for (size_t k = d; k + 1 < trace.size(); ++k) {
+            const Sample &in = trace[k - d];
+            const double x[3] = {trace[k].flow.toDouble(), in.valveOn ? in.pwm : 0.0, in.valveOn ? 1.0 : 0.0};
+            f(x, trace[k + 1].flow.toDouble());
+        }
+    }
+
+    static int clamp(int v, int lo, int hi) {
+        return v < lo ? lo : (v > hi ? hi : v);
+    }
+
+    /// Решает систему 3x3 (расширенная матрица) методом Гаусса.
+    static bool solve(double m[3][4], double p[3]) {
+        for (int col = 0; col < 3; ++col) {
+            int pivot = col;
+            for (int r = col + 1; r < 3; ++r)
+                if (std::fabs(m[r][col]) > std::fabs(m[pivot][col]))
+                    pivot = r;
+            if (std::fabs(m[pivot][col]) < 1e-12)
+                return false;
+            if (pivot != col)
+                for (int j = 0; j < 4; ++j)
+                    std::swap(m[pivot][j], m[col][j]);
+            for (int r = col + 1; r < 3; ++r) {
+                const double f = m[r][col] / m[col][col];
+                for (int j = col; j < 4; ++j)
+                    m[r][j] -= f * m[col][j];
+            }
+        }
+        for (int i = 2; i >= 0; --i) {
+            double s = m[i][3];
+            for (int j = i + 1; j < 3; ++j)
+                s -= m[i][j] * p[j];
+            p[i] = s / m[i][i];
+        }
+        return true;
+    }
+};
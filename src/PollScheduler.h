@@ -0,0 +1,241 @@
+/**
+ * @file PollScheduler.h
+ * @brief Многоскоростной планировщик опроса измерительных каналов устройства.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "SendAndReadData.h"
+
+/**
+ * @brief Планировщик опроса каналов с заданной частотой и приоритетом.
+ *
+ * Каждый канал (расход, давление, температура и т.п.) регистрируется
+ * со своей целевой частотой опроса и приоритетом. За один вызов
+ * @ref poll() планировщик выполняет только те запросы, срок которых
+ * наступил, в порядке убывания приоритета и не выходя за отведённое
+ * окно. Канал с периодом короче тика опрашивается в окне несколько раз,
+ * к своим срокам; запросы, не поместившиеся в окно, переносятся на
+ * следующий тик, поэтому добавление каналов не замедляет контур
+ * регулирования.
+ *
+ * Стоимость одной транзакции оценивается скользящим средним времени
+ * «запрос-ответ», измеренного транспортом без ожидания очереди к линии.
+ * Планировщик также считает фактическую частоту опроса каждого канала
+ * и загрузку линии.
+ *
+ * Опрос — сопрограмма: пока ждётся ответ, поток свободен.
+ */
+class PollScheduler {
+public:
+    /**
+     * @brief Описание и состояние одного опрашиваемого канала.
+     */
+    struct Channel {
+        const char *name;       ///< Имя канала (используется в логе).
+        unsigned char address;  ///< Адрес устройства.
+        unsigned char order;    ///< Код команды запроса.
+        unsigned char replyTag; ///< Тег ожидаемого ответа.
+        uint16_t arg;           ///< Закодированный аргумент запроса.
+        bool signedRaw;         ///< Значение передаётся со знаком (дополнительный код).
+        int scale;              ///< Масштаб значения (доли единицы в отсчёте).
+        double periodMs;        ///< Целевой период опроса (мс).
+        int priority;           ///< Приоритет: больше — раньше в очереди.
+        int32_t raw = 0;        ///< Последнее значение в единицах устройства (со знаком, если @ref signedRaw).
+        bool valid = false;     ///< Получено ли хотя бы одно значение.
+        double nextDueMs = 0.0; ///< Момент следующего запланированного опроса (мс).
+        int samples = 0;        ///< Количество выполненных опросов.
+        int deferred = 0;       ///< Сколько раз опрос был отложен из-за бюджета.
+        bool logged = true;     ///< Записывать ли каждое значение в текстовый лог.
+        std::function<void(int32_t)> onSample; ///< Обработчик каждого нового значения (@ref onSample()).
+    };
+
+    /**
+     * @brief Идентификатор канала, знающий тип его значения.
+     * @tparam T Величина @ref Fixed, в которую декодируется ответ канала.
+     */
+    template<typename T>
+    struct ChannelId {
+        int id;
+    };
+
+    /// Создаёт планировщик поверх общего транспорта @ref Data.
+    explicit PollScheduler(Data *dataPtr) : mydata(dataPtr) {
+        m_clock.start();
+    }
+
+    /**
+     * @brief Регистрирует канал опроса.
+     * @tparam Cmd     Команда протокола (см. @ref Protocol.h) с ответом типа @ref Fixed.
+     * @param name     Имя канала для лога.
+     * @param arg      Аргумент запроса.
+     * @param rateHz   Целевая частота опроса (Гц).
+     * @param priority Приоритет канала.
+     * @return Идентификатор канала для @ref value() и @ref channel().
+     */
+    template<typename Cmd>
+    ChannelId<typename Cmd::Reply> addChannel(const char *name, typename Cmd::Arg arg, double rateHz, int priority) {
+        static_assert(IsFixed<typename Cmd::Reply>::value, "polled channels carry fixed-point values");
+        Channel ch{name, Cmd::address, Cmd::order, Cmd::replyTag, Cmd::encode(arg), Cmd::signedRaw,
+                   Cmd::Reply::scale, 1000.0 / rateHz, priority};
+        ch.nextDueMs = m_clock.elapsed();
+        m_channels.append(ch);
+
+        const int id = m_channels.size() - 1;
+        m_order.append(id);
+        std::stable_sort(m_order.begin(), m_order.end(), [this](int a, int b) {
+            return m_channels[a].priority > m_channels[b].priority;
+        });
+        return ChannelId<typename Cmd::Reply>{id};
+    }
+
+    /**
+     * @brief Выполняет запросы, срок которых наступает в окне @p budgetMs.
+     *
+     * Сначала опрашиваются каналы, «созревшие» к началу окна: до их
+     * срока осталось меньше половины периода — это компенсирует дрожание
+     * таймера, и канал с периодом, равным периоду тика, опрашивается на
+     * каждом тике. Хотя бы один запрос выполняется всегда. Остаток окна
+     * сопрограмма ждёт ближайшего срока и опрашивает канал к нему, пока
+     * транзакция успевает завершиться до конца окна.
+     *
+     * @param budgetMs Длительность окна опроса от начала вызова (мс).
+     */
+    Coro::Task<> poll(qint64 budgetMs) {
+        const double endMs = m_clock.elapsed() + budgetMs;
+        bool any = false;
+
+        for (int id: m_order) {
+            const double now = m_clock.elapsed();
+            Channel &ch = m_channels[id];
+            if (ch.nextDueMs - now > ch.periodMs / 2)
+                continue;
+            if (any && now + m_costMs > endMs) {
+                ++ch.deferred;
+                continue;
+            }
+            const bool replied = co_await exchange(id);
+            if (!replied)
+                co_return;
+            any = true;
+        }
+
+        for (;;) {
+            const int id = earliestDue();
+            const double now = m_clock.elapsed();
+            const double dueMs = std::max(m_channels[id].nextDueMs, now);
+            if (dueMs + m_costMs > endMs)
+                co_return;
+            if (dueMs > now)
+                co_await Coro::sleep(static_cast<int>(std::ceil(dueMs - now)));
+            const bool replied = co_await exchange(id);
+            if (!replied)
+                co_return;
+        }
+    }
+
+    /// Последнее значение канала.
+    template<typename T>
+    T value(ChannelId<T> ch) const { return T::fromRaw(m_channels[ch.id].raw); }
+
+    /// Включает или выключает запись значений канала в текстовый лог.
+    template<typename T>
+    void setLogged(ChannelId<T> ch, bool logged) { m_channels[ch.id].logged = logged; }
+
+    /**
+     * @brief Назначает обработчик каждого нового значения канала.
+     *
+     * Обработчик вызывается сразу по приходу ответа, изнутри @ref poll(),
+     * т.е. с частотой опроса канала, а не раз за тик. Разрушать
+     * сопрограмму опроса он не должен.
+     */
+    template<typename T>
+    void onSample(ChannelId<T> ch, std::function<void(T)> handler) {
+        m_channels[ch.id].onSample = [handler = std::move(handler)](int32_t raw) { handler(T::fromRaw(raw)); };
+    }
+
+    /// Полное состояние канала.
+    const Channel &channel(int id) const { return m_channels[id]; }
+
+    /// Количество зарегистрированных каналов.
+    int channelCount() const { return m_channels.size(); }
+
+    /// Фактическая частота опроса канала с момента создания (Гц).
+    double achievedRate(int id) const {
+        const qint64 elapsed = m_clock.elapsed();
+        return elapsed > 0 ? m_channels[id].samples * 1000.0 / elapsed : 0.0;
+    }
+
+    /// Доля времени, в течение которого линия была занята обменом (0..1).
+    double utilisation() const {
+        const qint64 elapsed = m_clock.elapsed();
+        return elapsed > 0 ? m_busyMs / elapsed : 0.0;
+    }
+
+    /**
+     * @brief Краткая сводка: фактические частоты каналов и загрузка линии.
+     * @return Строка вида "FLOW 20.0/20.0 Hz, TEMP 1.0/1.0 Hz; link 34%".
+     */
+    QString report() const {
+        QStringList parts;
+        for (int id = 0; id < m_channels.size(); ++id) {
+            const Channel &ch = m_channels[id];
+            parts << QString("%1 %2/%3 Hz")
+                    .arg(QString::fromLatin1(ch.name))
+                    .arg(achievedRate(id), 0, 'f', 1)
+                    .arg(1000.0 / ch.periodMs, 0, 'f', 1);
+        }
+        return QString("%1; link %2%")
+                .arg(parts.join(", "))
+                .arg(utilisation() * 100, 0, 'f', 0);
+    }
+
+private:
+    /// Опрашивает канал @p id и планирует его следующий срок.
+    Coro::Task<bool> exchange(int id) {
+        Channel &ch = m_channels[id];
+        const double now = m_clock.elapsed();
+        Data::DataNode node;
+        const bool replied = co_await mydata->asyncExchange(ch.address, ch.order, ch.arg, ch.replyTag, &node);
+        if (!replied)
+            co_return false;
+        const double dt = mydata->lastRoundTripMs();
+
+        ch.raw = ch.signedRaw ? static_cast<int16_t>(node.data) : node.data;
+        if (ch.logged)
+            UART::logUARTData(ch.name, ch.raw);
+        ch.valid = true;
+        ++ch.samples;
+        ch.nextDueMs = std::max(ch.nextDueMs + ch.periodMs, now + ch.periodMs / 2);
+
+        m_costMs = m_costMs * 0.8 + dt * 0.2;
+        m_busyMs += dt;
+        if (ch.onSample)
+            ch.onSample(ch.raw);
+        co_return true;
+    }
+
+    /// Канал с ближайшим сроком опроса (при равенстве — более приоритетный).
+    int earliestDue() const {
+        int best = m_order.first();
+        for (int id: m_order)
+            if (m_channels[id].nextDueMs < m_channels[best].nextDueMs)
+                best = id;
+        return best;
+    }
+
+    Data *mydata;               ///< Общий объект транспорта данных.
+    QVector<Channel> m_channels; ///< Зарегистрированные каналы.
+    QVector<int> m_order;       ///< Индексы каналов по убыванию приоритета.
+    QElapsedTimer m_clock;      ///< Монотонные часы планировщика.
+    double m_costMs = 10.0;     ///< Оценка длительности одной транзакции (мс).
+    double m_busyMs = 0.0;      ///< Суммарное время занятости линии (мс).
+};
@@ -0,0 +1,159 @@
+/**
+ * @file Protocol.h
+ * @brief Описание команд протокола устройства на этапе компиляции.
+ *
+ * Каждая команда — это тип, несущий адрес устройства, код команды,
+ * тип аргумента запроса, ожидаемый тег ответа и масштаб перевода
+ * 16-битного «сырого» значения в единицы измерения. Измерения
+ * декодируются в величины с фиксированной точкой (@ref Fixed.h) без
+ * перевода в @c double. Через
+ * @ref Data::asyncRequest() команда отправляется и её ответ декодируется
+ * сразу в нужный тип без поиска по таблицам во время выполнения.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "Fixed.h"
+#include "orders.h"
+
+namespace Protocol {
+    /// Тип ответа команд, у которых значимо только подтверждение.
+    struct Ack {};
+
+    /**
+     * @brief Дескриптор команды в виде значений (для проверок на этапе компиляции).
+     */
+    struct Descriptor {
+        unsigned char address;
+        unsigned char order;
+        unsigned char replyTag;
+        int scaleNum;
+        int scaleDen;
+        bool signedRaw;  ///< Поле данных ответа — знаковое (дополнительный код).
+    };
+
+    /**
+     * @brief Команда протокола.
+     *
+     * @tparam Address  Адрес устройства.
+     * @tparam Order    Код команды.
+     * @tparam ArgT     Тип аргумента запроса (не шире 16 бит).
+     * @tparam ReplyT   Тип декодированного ответа (для @ref Fixed масштаб
+     *                  типа должен совпадать с масштабом Den / Num).
+     * @tparam Num      Числитель масштаба ответа.
+     * @tparam Den      Знаменатель масштаба ответа.
+     * @tparam RawT     Тип 16-битного поля данных ответа: @c int16_t для
+     *                  величин со знаком (давление), иначе @c uint16_t.
+     * @tparam ReplyTag Тег ожидаемого ответа (по умолчанию совпадает с командой).
+     */
+    template<unsigned char Address, unsigned char Order, typename ArgT, typename ReplyT,
+             int Num = 1, int Den = 1, typename RawT = uint16_t, unsigned char ReplyTag = Order>
+    struct Command {
+        static_assert(sizeof(ArgT) <= sizeof(uint16_t), "request payload must fit two data bytes");
+        static_assert(Den > 0, "scale denominator must be positive");
+        static_assert(std::is_same_v<RawT, uint16_t> || std::is_same_v<RawT, int16_t>,
+                      "reply payload is a 16-bit word");
+
+        using Arg = ArgT;
+        using Reply = ReplyT;
+
+        static constexpr unsigned char address = Address;
+        static constexpr unsigned char order = Order;
+        static constexpr unsigned char replyTag = ReplyTag;
+        static constexpr bool signedRaw = std::is_signed_v<RawT>;
+        static constexpr Descriptor descriptor{Address, Order, ReplyTag, Num, Den, signedRaw};
+
+        /// Кодирует аргумент в 16-битное поле данных кадра.
+        static constexpr uint16_t encode(Arg arg) {
+            return static_cast<uint16_t>(arg);
+        }
+
+        /// Расширяет поле данных ответа до целого с учётом знака.
+        static constexpr int32_t widen(uint16_t raw) {
+            return static_cast<RawT>(raw);
+        }
+
+        /// Переводит «сырое» значение ответа в @c Reply.
+        static constexpr Reply decode(uint16_t raw) {
+            if constexpr (std::is_same_v<Reply, Ack>) {
+                (void) raw;
+                return Ack{};
+            } else if constexpr (IsFixed<Reply>::value) {
+                static_assert(Reply::scale * Num == Den, "reply type scale differs from the wire scale");
+                return Reply::fromRaw(widen(raw));
+            } else {
+                return static_cast<Reply>(widen(raw)) * Num / Den;
+            }
+        }
+    };
+
+    // --- KEYS ---------------------------------------------------------------
+    /// Эмуляция нажатия клавиши; аргумент — KEY_xxx_SIG.
+    using KeySig = Command<KEYS::ADDRESS, KEYS::KEY_SIG, uint16_t, Ack>;
+
+    // --- REGUL --------------------------------------------------------------
+    /// Установка давления, мм рт. ст.
+    using SetPres = Command<REGUL::ADDRESS, REGUL::SET_PRES, uint16_t, Ack>;
+    /// Измеренный расход, л/мин (по проводу л/мин * 100); аргумент — режим CO₂.
+    using GetMsrFlow = Command<REGUL::ADDRESS, REGUL::GET_MSR_FLOW, bool, Units::Flow, 1, 100>;
+    /// Измеренное давление инсуффляции, мм рт. ст. (по проводу * 10, со знаком).
+    using GetMsrPres = Command<REGUL::ADDRESS, REGUL::GET_MSR_PRES, uint16_t, Units::Pressure, 1, 10, int16_t>;
+    /// Вычисленное давление редуктора, мм рт. ст. (по проводу * 10, со знаком).
+    using GetRdcPres = Command<REGUL::ADDRESS, REGUL::GET_RDC_PRES, uint16_t, Units::Pressure, 1, 10, int16_t>;
+    /// Среднее давление за импульс, мм рт. ст. (по проводу * 10, со знаком).
+    using GetMedPres = Command<REGUL::ADDRESS, REGUL::GET_MED_PRES, uint16_t, Units::Pressure, 1, 10, int16_t>;
+    /// Средний расход за импульс, л/мин (по проводу * 10).
+    using GetMedFlow = Command<REGUL::ADDRESS, REGUL::GET_MED_FLOW, uint16_t, Units::FlowTenths, 1, 10>;
+    /// Температура корпуса при выключенном нагревателе, °C (по проводу * 2).
+    using GetTemperature = Command<REGUL::ADDRESS, REGUL::GET_TEMPERATURE, uint16_t, Units::Temperature, 1, 2>;
+
+    // --- REDUC --------------------------------------------------------------
+    /// Включить подачу газа.
+    using OnFlow = Command<REDUC::ADDRESS, REDUC::ON_FLOW, uint16_t, Ack>;
+    /// Выключить подачу газа.
+    using OffFlow = Command<REDUC::ADDRESS, REDUC::OFF_FLOW, uint16_t, Ack>;
+    /// Установка ШИМ клапана.
+    using SetShim = Command<REDUC::ADDRESS, REDUC::SET_SHIM, uint16_t, Ack>;
+    /// Закрыть редуктор.
+    using ShutOff = Command<REDUC::ADDRESS, REDUC::SHUT_OFF, uint16_t, Ack>;
+
+    /// Таблица всех используемых команд.
+    constexpr Descriptor table[] = {
+        KeySig::descriptor,
+        SetPres::descriptor, GetMsrFlow::descriptor, GetMsrPres::descriptor,
+        GetRdcPres::descriptor, GetMedPres::descriptor, GetMedFlow::descriptor,
+        GetTemperature::descriptor,
+        OnFlow::descriptor, OffFlow::descriptor, SetShim::descriptor, ShutOff::descriptor,
+    };
+
+    /// Проверяет, что ответы разных команд одного устройства различимы по тегу.
+    constexpr bool replyTagsUnique() {
+        constexpr int n = sizeof(table) / sizeof(table[0]);
+        for (int i = 0; i < n; ++i)
+            for (int j = i + 1; j < n; ++j)
+                if (table[i].address == table[j].address && table[i].replyTag == table[j].replyTag)
+                    return false;
+        return true;
+    }
+
+    static_assert(replyTagsUnique(), "two commands share an address and a reply tag");
+
+    /**
+     * @brief Проверяет, что ответ ни одной команды не принять за сигнал тревоги.
+     *
+     * Сигнал инсуффлятора отличается от ответа регулятора (тот же адрес)
+     * только тегом, поэтому команды с тегом ответа из диапазона тревог
+     * (например, @c REGUL::GET_MSR_DATA) в протокол не включаются.
+     */
+    constexpr bool repliesDistinctFromAlarms() {
+        for (const Descriptor &d: table)
+            if (d.address == INSUF::ADDRESS && INSUF::isAlarm(d.replyTag))
+                return false;
+        return true;
+    }
+
+    static_assert(repliesDistinctFromAlarms(), "a reply tag collides with an alarm signal");
+}
@@ -0,0 +1,27 @@
+/**
+ * @file ResourceUsage.h
+ * @brief Счётчики выделений памяти и резидентная память процесса для длительных прогонов.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Потребление ресурсов процессом.
+ *
+ * Счётчики ведёт замена глобальных @c operator @c new / @c delete в
+ * ResourceUsage.cpp (одно атомарное приращение на вызов). Учитываются
+ * выделения кода приложения; выделения внутри разделяемых библиотек Qt
+ * на Windows идут через их собственный рантайм и сюда не попадают.
+ */
+namespace ResourceUsage {
+    /// Вызовы @c operator @c new с запуска процесса.
+    uint64_t allocations();
+
+    /// Вызовы @c operator @c delete с запуска процесса.
+    uint64_t deallocations();
+
+    /// Резидентная память процесса, байт (0 — платформа не поддерживается).
+    uint64_t residentBytes();
+}
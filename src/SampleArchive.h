@@ -0,0 +1,342 @@
+/**
+ * @file SampleArchive.h
+ * @brief Сжатый поколоночный архив измерений одной сессии настройки.
+ */
+
+#pragma once
+
+#include <QFile>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstdint>
+
+/**
+ * @brief Формат архива сессии (*.vta).
+ *
+ * @code
+ * FileHeader
+ * Block 0: BlockHeader | время | расход | PWM
+ * Block 1: ...
+ * @endcode
+ *
+ * Каждый блок содержит до @ref BLOCK_SAMPLES измерений. Первое измерение
+ * блока хранится в заголовке целиком, остальные — в трёх колонках
+ * zigzag-varint: для времени — вторая разность (при постоянном периоде
+ * опроса это нули, 1 байт), для расхода (л/мин * 100) и PWM — первая
+ * разность. Все числа — little-endian.
+ *
+ * Блок самоописывающий: заголовок начинается с @ref BLOCK_MAGIC и хранит
+ * число измерений и длины колонок. Писатель сбрасывает блок на диск, как
+ * только тот заполнится, а индекс блоков читатель строит сам, проходя по
+ * заголовкам. Поэтому при аварийном завершении теряется только
+ * незаписанный хвост (не больше одного блока), а недописанный последний
+ * блок отбрасывается при чтении.
+ */
+namespace SampleArchive {
+    constexpr uint32_t FILE_MAGIC = 0x41535456;   ///< "VTSA".
+    constexpr uint32_t BLOCK_MAGIC = 0x42535456;  ///< "VTSB".
+    constexpr uint16_t VERSION = 2;
+    constexpr int BLOCK_SAMPLES = 256;            ///< ~13 с опроса расхода на 20 Гц (пишется каждое измерение).
+    constexpr int MAX_VARINT_SIZE = 10;           ///< Длина varint для 64-битного значения.
+
+    /// Одно измерение в единицах устройства.
+    struct Record {
+        int64_t timestampMs; ///< Время UTC, мс от эпохи Unix.
+        int32_t flow;        ///< Расход, л/мин * 100.
+        int32_t pwm;         ///< PWM клапана.
+    };
+
+    /// Запись индекса блоков (строится читателем по заголовкам).
+    struct IndexEntry {
+        uint64_t offset;      ///< Смещение блока от начала файла.
+        int64_t firstTimeMs;  ///< Время первого измерения блока.
+        uint32_t count;       ///< Количество измерений в блоке.
+    };
+
+    constexpr int FILE_HEADER_SIZE = 4 + 2 + 2;
+    constexpr int BLOCK_HEADER_SIZE = 4 + 4 + 8 + 4 + 4 + 4 + 4 + 4;
+
+    inline uint64_t zigzag(int64_t v) {
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t v) {
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    inline void putVarint(QByteArray &out, uint64_t v) {
+        while (v >= 0x80) {
+            out.append(static_cast<char>(v | 0x80));
+            v >>= 7;
+        }
+        out.append(static_cast<char>(v));
+    }
+
+    /// Читает varint; при выходе за @p end возвращает 0 и ставит @p p в @p end.
+    inline uint64_t getVarint(const uchar *&p, const uchar *end) {
+        uint64_t v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            const uchar b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        p = end;
+        return 0;
+    }
+
+    template<typename T>
+    void putLE(QByteArray &out, T v) {
+        char buf[sizeof(T)];
+        qToLittleEndian(v, buf);
+        out.append(buf, sizeof(T));
+    }
+
+    template<typename T>
+    T getLE(const uchar *p) {
+        return qFromLittleEndian<T>(p);
+    }
+}
+
+/**
+ * @brief Дописывает измерения сессии в архив.
+ */
+class SampleArchiveWriter {
+public:
+    /**
+     * @brief Создаёт файл архива.
+     * @param path Путь к файлу; существующий файл перезаписывается.
+     */
+    explicit SampleArchiveWriter(const QString &path) : m_file(path) {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return;
+        QByteArray header;
+        SampleArchive::putLE<uint32_t>(header, SampleArchive::FILE_MAGIC);
+        SampleArchive::putLE<uint16_t>(header, SampleArchive::VERSION);
+        SampleArchive::putLE<uint16_t>(header, 0);
+        m_file.write(header);
+        m_time.reserve(SampleArchive::BLOCK_SAMPLES * 2);
+        m_flow.reserve(SampleArchive::BLOCK_SAMPLES * 2);
+        m_pwm.reserve(SampleArchive::BLOCK_SAMPLES * 2);
+    }
+
+    ~SampleArchiveWriter() { close(); }
+
+    /// @c true, если файл открыт для записи.
+    bool isOpen() const { return m_file.isOpen(); }
+
+    /// Текст ошибки файла.
+    QString errorString() const { return m_file.errorString(); }
+
+    /// Добавляет измерение; полный блок сразу записывается и сбрасывается на диск.
+    void append(const SampleArchive::Record &r) {
+        if (!m_file.isOpen())
+            return;
+
+        if (m_count == 0) {
+            m_first = r;
+            m_prevDelta = 0;
+        } else {
+            const int64_t delta = r.timestampMs - m_prev.timestampMs;
+            SampleArchive::putVarint(m_time, SampleArchive::zigzag(delta - m_prevDelta));
+            SampleArchive::putVarint(m_flow, SampleArchive::zigzag(int64_t(r.flow) - m_prev.flow));
+            SampleArchive::putVarint(m_pwm, SampleArchive::zigzag(int64_t(r.pwm) - m_prev.pwm));
+            m_prevDelta = delta;
+        }
+        m_prev = r;
+
+        if (++m_count == SampleArchive::BLOCK_SAMPLES)
+            flushBlock();
+    }
+
+    /// Записывает неполный блок и закрывает файл.
+    void close() {
+        if (!m_file.isOpen())
+            return;
+        flushBlock();
+        m_file.close();
+    }
+
+private:
+    void flushBlock() {
+        if (m_count == 0)
+            return;
+
+        QByteArray block;
+        SampleArchive::putLE<uint32_t>(block, SampleArchive::BLOCK_MAGIC);
+        SampleArchive::putLE<uint32_t>(block, m_count);
+        SampleArchive::putLE<int64_t>(block, m_first.timestampMs);
+        SampleArchive::putLE<int32_t>(block, m_first.flow);
+        SampleArchive::putLE<int32_t>(block, m_first.pwm);
+        SampleArchive::putLE<uint32_t>(block, m_time.size());
+        SampleArchive::putLE<uint32_t>(block, m_flow.size());
+        SampleArchive::putLE<uint32_t>(block, m_pwm.size());
+        block.append(m_time).append(m_flow).append(m_pwm);
+
+        m_file.write(block);
+        m_file.flush();
+
+        m_time.clear();
+        m_flow.clear();
+        m_pwm.clear();
+        m_count = 0;
+    }
+
+    QFile m_file;                               ///< Файл архива.
+    QByteArray m_time;                          ///< Колонка времени текущего блока.
+    QByteArray m_flow;                          ///< Колонка расхода текущего блока.
+    QByteArray m_pwm;                           ///< Колонка PWM текущего блока.
+    SampleArchive::Record m_first{};            ///< Первое измерение блока.
+    SampleArchive::Record m_prev{};             ///< Предыдущее измерение.
+    int64_t m_prevDelta = 0;                    ///< Предыдущая разность времени.
+    uint32_t m_count = 0;                       ///< Измерений в текущем блоке.
+};
+
+/**
+ * @brief Последовательное чтение архива через отображение файла в память.
+ */
+class SampleArchiveReader {
+public:
+    /**
+     * @brief Открывает архив и строит индекс по заголовкам блоков.
+     *
+     * Проход останавливается на первом блоке, который не помещается в
+     * файл или не проходит проверку заголовка: обычно это недописанный
+     * хвост после аварийного завершения, см. @ref isTruncated().
+     * @param path Путь к файлу архива.
+     */
+    explicit SampleArchiveReader(const QString &path) : m_file(path) {
+        if (!m_file.open(QIODevice::ReadOnly))
+            return;
+        const qint64 size = m_file.size();
+        if (size < SampleArchive::FILE_HEADER_SIZE)
+            return;
+        const uchar *data = m_file.map(0, size);
+        if (!data)
+            return;
+
+        using SampleArchive::getLE;
+        if (getLE<uint32_t>(data) != SampleArchive::FILE_MAGIC ||
+            getLE<uint16_t>(data + 4) != SampleArchive::VERSION)
+            return;
+
+        qint64 offset = SampleArchive::FILE_HEADER_SIZE;
+        while (size - offset >= SampleArchive::BLOCK_HEADER_SIZE) {
+            const uchar *p = data + offset;
+            const uint32_t count = getLE<uint32_t>(p + 4);
+            const qint64 end = offset + SampleArchive::BLOCK_HEADER_SIZE + blockBytes(p);
+            if (getLE<uint32_t>(p) != SampleArchive::BLOCK_MAGIC || !validHeader(p) || end > size)
+                break;
+            m_index.append(SampleArchive::IndexEntry{static_cast<uint64_t>(offset), getLE<int64_t>(p + 8), count});
+            offset = end;
+        }
+        m_truncated = offset != size;
+        m_data = data;
+        m_size = size;
+    }
+
+    /// @c true, если архив открыт и индекс прочитан.
+    bool isValid() const { return m_data != nullptr; }
+
+    /// @c true, если после последнего целого блока в файле остались недописанные данные.
+    bool isTruncated() const { return m_truncated; }
+
+    /// Индекс блоков (время первого измерения, количество).
+    const QVector<SampleArchive::IndexEntry> &index() const { return m_index; }
+
+    /// Общее количество измерений.
+    qint64 sampleCount() const {
+        qint64 n = 0;
+        for (const SampleArchive::IndexEntry &e: m_index)
+            n += e.count;
+        return n;
+    }
+
+    /**
+     * @brief Декодирует блок.
+     * @param block Номер блока в @ref index().
+     * @param out   Буфер, в конец которого добавляются измерения.
+     * @return @c false, если блок повреждён.
+     */
+    bool readBlock(int block, QVector<SampleArchive::Record> *out) const {
+        using SampleArchive::getLE;
+        const SampleArchive::IndexEntry &e = m_index[block];
+        if (e.offset + SampleArchive::BLOCK_HEADER_SIZE > uint64_t(m_size))
+            return false;
+
+        const uchar *p = m_data + e.offset;
+        if (!validHeader(p) || e.offset + SampleArchive::BLOCK_HEADER_SIZE + blockBytes(p) > uint64_t(m_size))
+            return false;
+        const uint32_t count = getLE<uint32_t>(p + 4);
+        SampleArchive::Record r{getLE<int64_t>(p + 8), getLE<int32_t>(p + 16), getLE<int32_t>(p + 20)};
+        const uchar *timeEnd = p + SampleArchive::BLOCK_HEADER_SIZE + getLE<uint32_t>(p + 24);
+        const uchar *flowEnd = timeEnd + getLE<uint32_t>(p + 28);
+        const uchar *pwmEnd = flowEnd + getLE<uint32_t>(p + 32);
+        const uchar *t = p + SampleArchive::BLOCK_HEADER_SIZE;
+        const uchar *f = timeEnd;
+        const uchar *w = flowEnd;
+
+        out->reserve(out->size() + count);
+        out->append(r);
+        int64_t delta = 0;
+        for (uint32_t i = 1; i < count; ++i) {
+            delta += SampleArchive::unzigzag(SampleArchive::getVarint(t, timeEnd));
+            r.timestampMs += delta;
+            r.flow += static_cast<int32_t>(SampleArchive::unzigzag(SampleArchive::getVarint(f, flowEnd)));
+            r.pwm += static_cast<int32_t>(SampleArchive::unzigzag(SampleArchive::getVarint(w, pwmEnd)));
+            out->append(r);
+        }
+        return t == timeEnd && f == flowEnd && w == pwmEnd;
+    }
+
+    /**
+     * @brief Последовательно декодирует весь архив.
+     * @param fn Вызывается для каждого измерения: @c fn(const Record &).
+     * @return @c false, если встретился повреждённый блок.
+     */
+    template<typename Fn>
+    bool forEach(Fn fn) const {
+        QVector<SampleArchive::Record> buf;
+        for (int i = 0; i < m_index.size(); ++i) {
+            buf.clear();
+            if (!readBlock(i, &buf))
+                return false;
+            for (const SampleArchive::Record &r: buf)
+                fn(r);
+        }
+        return true;
+    }
+
+private:
+    /// Суммарная длина колонок блока с заголовком @p p.
+    static qint64 blockBytes(const uchar *p) {
+        using SampleArchive::getLE;
+        return qint64(getLE<uint32_t>(p + 24)) + getLE<uint32_t>(p + 28) + getLE<uint32_t>(p + 32);
+    }
+
+    /**
+     * @brief Проверяет число измерений блока и длины колонок.
+     *
+     * Каждая из @c count-1 разностей занимает в колонке от 1 до
+     * @ref SampleArchive::MAX_VARINT_SIZE байт.
+     */
+    static bool validHeader(const uchar *p) {
+        using SampleArchive::getLE;
+        const uint32_t count = getLE<uint32_t>(p + 4);
+        if (count < 1 || count > uint32_t(SampleArchive::BLOCK_SAMPLES))
+            return false;
+        for (int column = 0; column < 3; ++column) {
+            const uint32_t bytes = getLE<uint32_t>(p + 24 + 4 * column);
+            if (bytes < count - 1 || bytes > (count - 1) * SampleArchive::MAX_VARINT_SIZE)
+                return false;
+        }
+        return true;
+    }
+
+    QFile m_file;                               ///< Файл архива (держит отображение).
+    const uchar *m_data = nullptr;              ///< Отображение файла.
+    qint64 m_size = 0;                          ///< Размер файла.
+    QVector<SampleArchive::IndexEntry> m_index; ///< Индекс блоков.
+    bool m_truncated = false;                   ///< Файл обрывается внутри блока.
+};
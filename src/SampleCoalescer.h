@@ -0,0 +1,84 @@
+/**
+ * @file SampleCoalescer.h
+ * @brief Накопитель измерений между кадрами отображения.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "Fixed.h"
+
+/**
+ * @brief Развязывает частоту сбора данных и частоту обновления интерфейса.
+ *
+ * Каждое измерение расхода приходит через @ref pushFlow() с частотой
+ * опроса канала, состояние регулятора (PWM, ошибка, давление,
+ * температура) — через @ref pushState() раз за тик. Сохраняется только
+ * последний снимок и минимум/максимум расхода за текущий интервал.
+ * Интерфейс забирает накопленное через @ref take() не чаще одного раза
+ * за кадр; если новых измерений не было, @ref take() возвращает
+ * @c false и перерисовку можно пропустить.
+ */
+class SampleCoalescer {
+public:
+    /**
+     * @brief Снимок для публикации в интерфейс.
+     */
+    struct Snapshot {
+        int pwm = 0;                     ///< Последний PWM.
+        Units::Flow flow;                ///< Последний расход.
+        Units::Flow error;               ///< Последняя ошибка регулирования.
+        Units::Pressure pressure;        ///< Последнее давление.
+        Units::Temperature temperature;  ///< Последняя температура.
+        Units::Flow flowMin;             ///< Минимальный расход за интервал.
+        Units::Flow flowMax;             ///< Максимальный расход за интервал.
+        int count = 0;                   ///< Количество измерений расхода за интервал.
+    };
+
+    /// Добавляет измерение расхода в текущий интервал.
+    void pushFlow(Units::Flow flow) {
+        if (m_pending.count == 0)
+            m_pending.flowMin = m_pending.flowMax = flow;
+        m_pending.flow = flow;
+        m_pending.flowMin = std::min(m_pending.flowMin, flow);
+        m_pending.flowMax = std::max(m_pending.flowMax, flow);
+        ++m_pending.count;
+    }
+
+    /// Обновляет состояние регулятора, которое меняется раз за тик.
+    void pushState(int pwm, Units::Flow error, Units::Pressure pressure, Units::Temperature temperature) {
+        m_pending.pwm = pwm;
+        m_pending.error = error;
+        m_pending.pressure = pressure;
+        m_pending.temperature = temperature;
+        m_stateChanged = true;
+    }
+
+    /**
+     * @brief Забирает накопленный интервал и начинает новый.
+     * @param out Снимок для заполнения.
+     * @return @c false, если с прошлого вызова измерений не было.
+     */
+    bool take(Snapshot *out) {
+        if (m_pending.count == 0 && !m_stateChanged)
+            return false;
+        *out = m_pending;
+        // за интервал без измерений расхода диапазон — последний расход
+        if (m_pending.count == 0)
+            out->flowMin = out->flowMax = m_pending.flow;
+        m_pending.count = 0;
+        m_stateChanged = false;
+        return true;
+    }
+
+    /// Отбрасывает накопленные, но не опубликованные измерения.
+    void clear() {
+        m_pending = Snapshot{};
+        m_stateChanged = false;
+    }
+
+private:
+    Snapshot m_pending;          ///< Накапливаемый интервал.
+    bool m_stateChanged = false; ///< С прошлого @ref take() обновлялось состояние регулятора.
+};
@@ -5,7 +5,15 @@
 
 #pragma once
 
+#include <QVector>
+
+#include <functional>
+
+#include "Coroutine.h"
 #include "USART.h"
+#include "orders.h"
+#include "Protocol.h"
+#include "Metrics.h"
 
 /// Глобальный указатель на UART, используемый классами @ref Data и @ref Controller.
 static UART *uart = nullptr;
@@ -15,18 +23,18 @@ static UART *uart = nullptr;
  *
  * Наследует @ref UART и добавляет:
  *  - формирование кадров (FEND/FESC, экранирование служебных байт),
- *  - расчёт контрольной суммы CRC8,
- *  - удобные методы @ref SendData и @ref RecieveData для кода алгоритма.
+ *  - расчёт и проверку контрольной суммы CRC8 (повреждённые кадры отбрасываются),
+ *  - ожидаемые из сопрограмм запросы (@ref asyncRequest()), которые не
+ *    блокируют поток, по очереди делят линию между последовательностями
+ *    и завершаются неудачей, если устройство не ответило в срок,
+ *  - диспетчеризацию незапрошенных кадров (сигналов и тревог устройства)
+ *    подписчикам и аварийное перекрытие подачи газа при критической тревоге.
+ *
+ * Порт разбирается постоянно, а не только пока ждётся ответ: каждый
+ * приход данных вычитывает все готовые кадры, так что тревога,
+ * пришедшая между обменами, перекрывает газ сразу же.
  */
-class Data : public UART {
-    /// Специальные байты, используемые в кадрирующем протоколе.
-    enum {
-        FEND = 0xC0, ///< Frame End.
-        FESC = 0xDB, ///< Frame Escape.
-        TFEND = 0xDC, ///< Transposed Frame End.
-        TFESC = 0xDD, ///< Transposed Frame Escape.
-    };
-
+class Data : public UART, private UART::Listener {
     static unsigned char CRC_calc(const unsigned char *buffer, unsigned int len) {
         unsigned char crc = 0xDE;
         while (len--) {
@@ -47,37 +55,68 @@ public:
     /**
      * @brief Распарсенный ответ от устройства в удобном виде.
      *
+     * @var DataNode::address
+     *   Адрес устройства-отправителя.
      * @var DataNode::tag
      *   Идентификатор тега/команды протокола.
      * @var DataNode::data
-     *   Числовое значение полезной нагрузки (уже объединённое из двух байт).
+     *   «Сырое» значение полезной нагрузки (уже объединённое из двух байт).
+     *   Перевод в единицы измерения выполняет @ref Protocol::Command::decode().
      */
     struct DataNode {
+        unsigned char address;
         char tag;
-        double data;
+        uint16_t data;
     };
 
-    /// Конструирует транспорт данных, используя заданное имя COM-порта.
-    explicit Data(const QString &Portname) : UART(Portname) {}
+    /// Обработчик кадра, на который оформлена подписка.
+    using Handler = std::function<void(const DataNode &)>;
+
+    /// Значение адреса/тега подписки, совпадающее с любым кадром.
+    static constexpr int ANY = -1;
+
+    /// Сколько раз отправляется не подтверждённая команда отключения подачи (@ref asyncSafetyRequest()).
+    static constexpr int SAFETY_ATTEMPTS = 3;
+
+    /**
+     * @brief Конструирует транспорт данных, используя заданное имя COM-порта.
+     *
+     * Подписывается на приход данных глобального @ref uart, который
+     * должен быть создан раньше и пережить этот объект.
+     */
+    explicit Data(const QString &Portname) : UART(Portname) {
+        if (uart)
+            uart->setListener(this);
+    }
+
+    ~Data() {
+        if (uart)
+            uart->setListener(nullptr);
+    }
 
     /**
-     * @brief Отправляет закодированную команду с двумя одно байтовыми полями данных.
+     * @brief Ставит команду в очередь передачи, не дожидаясь её отправки.
      *
-     * Функция формирует кадр протокола: добавляет заголовок, считает CRC8,
-     * выполняет байт-стаффинг служебных байт, а затем передаёт результат
-     * в @ref UART::transmitUART().
+     * Кадр формируется @ref encodeFrame() и передаётся в @ref UART::writeUART().
+     * Ответ, если нужен, ждут сопрограммой (@ref asyncExchange()).
      *
      * @param address Адрес устройства.
      * @param command Код команды.
-     * @param data1   Первый байт данных.
-     * @param data2   Второй байт данных.
-     * @param fend    Маркер начала/конца кадра (по умолчанию @c FEND).
+     * @param data    16-битное значение данных.
      */
-    void SendData(unsigned char address,
-                  unsigned char command,
-                  unsigned char data1,
-                  unsigned char data2,
-                  unsigned char fend = FEND) {
+    void PostData(unsigned char address, unsigned char command, uint16_t data) {
+        QByteArray result = encodeFrame(address, command, (data & 0xFF), (data & 0xff00) >> 8, FEND);
+        uart->writeUART(result);
+    }
+
+    /**
+     * @brief Формирует кадр протокола: заголовок, CRC8 и байт-стаффинг служебных байт.
+     */
+    static QByteArray encodeFrame(unsigned char address,
+                                  unsigned char command,
+                                  unsigned char data1,
+                                  unsigned char data2,
+                                  unsigned char fend) {
         QByteArray data;
         data.append(fend);
         data.append(address);
@@ -106,56 +145,354 @@ public:
                 result.append(dataWithCRC[i]);
             }
         }
+        return result;
+    }
 
-        uart->transmitUART(result);
+    /**
+     * @brief Забирает из порта и декодирует один кадр, если он уже пришёл целиком.
+     *
+     * Повреждённые кадры (@ref decodeFrame()) пропускаются и учитываются
+     * в @c badFrames: ни ответом, ни тревогой они не считаются.
+     * @return @c false, если целого неповреждённого кадра ещё нет (@p node не изменяется).
+     */
+    bool PollData(DataNode *node) {
+        for (;;) {
+            const QByteArray data = uart->pollUART();
+            if (data.isEmpty())
+                return false;
+            if (decodeFrame(data, node))
+                return true;
+            metrics().badFrames.inc();
+            logUARTData("DROPPED", data);
+        }
     }
 
     /**
-     * @brief Отправляет команду с 16-битным значением данных.
+     * @brief Снимает экранирование, проверяет длину и CRC и разбирает кадр в @ref DataNode.
      *
-     * Значение разбивается на два байта и передаётся во второй вариант SendData().
+     * Снимаются только пары FESC TFEND и FESC TFESC. Любой другой байт
+     * после FESC, FEND внутри кадра, длина без экранирования, отличная
+     * от @ref PACKET_SIZE, или несовпадение CRC означают повреждённый кадр.
+     * @return @c false для повреждённого кадра (@p node не изменяется).
+     */
+    static bool decodeFrame(const QByteArray &data, DataNode *node) {
+        if (data.isEmpty() || static_cast<unsigned char>(data[0]) != FEND)
+            return false;
+
+        unsigned char frame[PACKET_SIZE];
+        int size = 0;
+        frame[size++] = FEND;
+        for (int i = 1; i < data.size(); i++) {
+            unsigned char currentByte = data[i];
+            if (currentByte == FEND || size == PACKET_SIZE)
+                return false;
+            if (currentByte == FESC) {
+                if (++i == data.size())
+                    return false;
+                const unsigned char escaped = data[i];
+                if (escaped == TFEND)
+                    currentByte = FEND;
+                else if (escaped == TFESC)
+                    currentByte = FESC;
+                else
+                    return false;
+            }
+            frame[size++] = currentByte;
+        }
+        if (size != PACKET_SIZE || CRC_calc(frame, PACKET_SIZE - 1) != frame[PACKET_SIZE - 1])
+            return false;
+
+        metrics().frames.inc();
+        node->address = frame[1];
+        node->tag = static_cast<char>(frame[2]);
+        node->data = static_cast<uint16_t>(frame[3] | (frame[4] << 8));
+        return true;
+    }
+
+    /**
+     * @brief Подписывает обработчик на незапрошенные кадры.
      *
-     * @param address Адрес устройства.
-     * @param command Код команды.
-     * @param data    16-битное значение данных.
+     * Обработчик вызывается синхронно, как только кадр прочитан из
+     * порта, т.е. без ожидания следующего тика, — в том числе изнутри
+     * ожидающей ответ сопрограммы. Поэтому обработчик не должен
+     * разрушать сопрограммы; тяжёлую реакцию он откладывает в цикл событий.
+     *
+     * @param address Адрес отправителя или @ref ANY.
+     * @param tag     Тег (номер сигнала) или @ref ANY.
+     * @param handler Вызываемый обработчик.
+     */
+    void subscribe(int address, int tag, Handler handler) {
+        m_subscriptions.append({address, tag, std::move(handler)});
+    }
+
+    /// Удаляет все подписки.
+    void unsubscribeAll() {
+        m_subscriptions.clear();
+    }
+
+    /**
+     * @brief Ожидание ответа на отправленную команду без блокировки потока.
+     *
+     * Ответ узнаётся по адресу и тегу; все прочие кадры, пришедшие за
+     * время ожидания, уходят в @ref dispatch(). @c co_await возвращает
+     * @c true, когда ответ получен, и @c false по тайм-ауту (тогда
+     * @c node->tag равен @c REGUL::TERROR) или при критической тревоге:
+     * после аварийного перекрытия газа ответа можно не дождаться.
+     * Продолжение сопрограммы откладывается до следующего прохода цикла
+     * событий.
+     */
+    class Reply {
+    public:
+        /// @p safety — ответ на команду отключения подачи: критическая тревога его ожидание не прерывает.
+        Reply(Data *data, unsigned char address, unsigned char tag, DataNode *node, int timeoutMs,
+              bool safety = false)
+            : m_data(data), m_address(address), m_tag(tag), m_node(node), m_timeoutMs(timeoutMs),
+              m_safety(safety) {}
+        Reply(const Reply &) = delete;
+        Reply &operator=(const Reply &) = delete;
+
+        /// При отмене ожидающей сопрограммы ответ больше не ждётся.
+        ~Reply() {
+            if (m_data->m_reply == this)
+                m_data->m_reply = nullptr;
+        }
+
+        bool await_ready() {
+            if (m_data->m_alarm && !m_safety)
+                return true;
+            m_data->m_reply = this;
+            m_data->drain();    // ответ мог прийти до ожидания
+            return m_done;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            m_handle = h;
+            m_timer.setSingleShot(true);
+            QObject::connect(&m_timer, &QTimer::timeout, &m_timer, [this] {
+                metrics().portErrors.inc();
+                m_node->address = 0;
+                m_node->tag = REGUL::TERROR;
+                m_node->data = 0;
+                finish(false);
+            });
+            m_timer.start(m_timeoutMs);
+        }
+
+        bool await_resume() const noexcept { return m_ok; }
+
+    private:
+        friend class Data;
+
+        /// Является ли кадр ожидаемым ответом.
+        bool matches(const DataNode &node) const {
+            return node.address == m_address && static_cast<unsigned char>(node.tag) == m_tag;
+        }
+
+        void finish(bool ok) {
+            m_data->m_reply = nullptr;
+            m_timer.stop();
+            m_ok = ok;
+            m_done = true;
+            if (m_handle)
+                Coro::detail::resumeLater(&m_timer, std::exchange(m_handle, {}));
+        }
+
+        Data *m_data;
+        unsigned char m_address;
+        unsigned char m_tag;
+        DataNode *m_node;
+        int m_timeoutMs;
+        bool m_safety;
+        bool m_ok = false;
+        bool m_done = false;
+        QTimer m_timer;                   ///< Тайм-аут ожидания (и владелец отложенного продолжения).
+        std::coroutine_handle<> m_handle; ///< Ожидающая сопрограмма.
+    };
+
+    /// Ожидаемый ответ с адреса @p address с тегом @p tag, см. @ref Reply.
+    Reply asyncWaitReply(unsigned char address, unsigned char tag, DataNode *node,
+                         int timeoutMs = UART::MAX_WAIT_MS) {
+        return Reply(this, address, tag, node, timeoutMs);
+    }
+
+    /**
+     * @brief Обмен «запрос-ответ» с «сырыми» полями, не блокирующий поток.
+     *
+     * На время обмена линия занимается: запросы других
+     * последовательностей ждут своей очереди и не перемешиваются с ним.
+     * Срок @p timeoutMs отсчитывается от отправки команды. Ответ не
+     * должен совпадать с сигналом тревоги (см. @ref Protocol::repliesDistinctFromAlarms()).
+     * @return @c false, если ответа нет в срок или зафиксирована критическая тревога.
      */
-    void SendData(unsigned char address, unsigned char command, uint16_t data) {
-        SendData(address, command, (data & 0xFF), (data & 0xff00) >> 8);
+    Coro::Task<bool> asyncExchange(unsigned char address, unsigned char command, uint16_t data,
+                                   unsigned char tag, DataNode *node, int timeoutMs = UART::MAX_WAIT_MS) {
+        Q_ASSERT(!(address == INSUF::ADDRESS && INSUF::isAlarm(tag)));
+        const Coro::Mutex::Lock lock = co_await m_link.lock();
+        if (m_alarm)
+            co_return false;
+        PostData(address, command, data);
+        m_sentAt.start();
+        const bool replied = co_await asyncWaitReply(address, tag, node, timeoutMs);
+        if (replied) {
+            m_lastRttMs = m_sentAt.nsecsElapsed() / 1e6;
+            metrics().rttSeconds.observe(m_lastRttMs / 1000);
+        }
+        co_return replied;
     }
 
     /**
-     * @brief Принимает и декодирует один кадр ответа от устройства.
+     * @brief Отправляет команду протокола и декодирует её ответ: @c co_await data->asyncRequest<Cmd>(arg, &reply).
      *
-     * Метод выполняет обратный байт-стаффинг и извлекает тег и 16-битное
-     * значение в структуру @ref DataNode.
+     * Адрес, код команды, тег ответа и масштаб берутся из описания
+     * @p Cmd (см. @ref Protocol.h) на этапе компиляции.
      *
-     * @param node Указатель на структуру, в которую будет помещён результат.
+     * @tparam Cmd  Команда из пространства имён @ref Protocol.
+     * @param arg   Аргумент запроса.
+     * @param reply Куда записать декодированный ответ (может быть @c nullptr).
+     * @return @c false, если ответа нет в срок или ожидание прервано критической тревогой.
      */
-    void RecieveData(DataNode *node) {
-        QByteArray data;
-        data = uart->recieveUART();
+    template<typename Cmd>
+    Coro::Task<bool> asyncRequest(typename Cmd::Arg arg, typename Cmd::Reply *reply) {
+        DataNode node;
+        const bool replied = co_await asyncExchange(Cmd::address, Cmd::order, Cmd::encode(arg), Cmd::replyTag, &node);
+        if (!replied)
+            co_return false;
+        if (reply)
+            *reply = Cmd::decode(node.data);
+        co_return true;
+    }
 
-        QByteArray result;
-        result.append(data[0]);
+    /// Сопрограммный запрос, дожидающийся лишь подтверждения.
+    template<typename Cmd>
+    Coro::Task<bool> asyncRequest(typename Cmd::Arg arg = {}) {
+        return asyncRequest<Cmd>(arg, nullptr);
+    }
 
-        for (int i = 1; i < data.size(); i++) {
-            // de-byte stuffing
-            unsigned char currentByte = data[i];
-            if (currentByte == FESC) {
-                continue;
-            } else if (currentByte == TFEND) {
-                result.append(FEND);
-            } else if (currentByte == TFESC) {
-                result.append(FESC);
-            } else {
-                result.append(currentByte);
+    /**
+     * @brief Команда отключения подачи с подтверждением: @c co_await data->asyncSafetyRequest<Protocol::ShutOff>().
+     *
+     * В отличие от @ref asyncRequest() отправляется и после критической
+     * тревоги, а ожидание её ответа тревога не прерывает. Не
+     * подтверждённая в срок команда повторяется, всего до
+     * @ref SAFETY_ATTEMPTS раз, не отдавая линию другим последовательностям.
+     * @return @c false, если устройство не подтвердило команду ни разу.
+     */
+    template<typename Cmd>
+    Coro::Task<bool> asyncSafetyRequest() {
+        static_assert(std::is_same_v<typename Cmd::Reply, Protocol::Ack>, "a safety command carries no payload");
+        const Coro::Mutex::Lock lock = co_await m_link.lock();
+        for (int attempt = 1; attempt <= SAFETY_ATTEMPTS; ++attempt) {
+            DataNode node;
+            PostData(Cmd::address, Cmd::order, Cmd::encode({}));
+            const bool replied = co_await Reply(this, Cmd::address, Cmd::replyTag, &node, UART::MAX_WAIT_MS, true);
+            if (replied)
+                co_return true;
+            logToFile(QString("Command %1 not acknowledged (attempt %2 of %3)")
+                .arg(Cmd::order).arg(attempt).arg(SAFETY_ATTEMPTS));
+        }
+        co_return false;
+    }
+
+    /**
+     * @brief Маршрутизирует незапрошенный кадр подписчикам.
+     *
+     * Сюда попадают только кадры с верным CRC (@ref PollData()).
+     * Критическая тревога фиксируется, ожидание текущего ответа
+     * прерывается, и сразу же, до вызова подписчиков, начинается
+     * перекрытие редуктора командой @c SHUT_OFF с подтверждением и
+     * повтором (@ref asyncSafetyRequest()): она уходит, как только
+     * освободится линия, т.е. после прерванного обмена.
+     */
+    void dispatch(const DataNode &node) {
+        const unsigned char tag = static_cast<unsigned char>(node.tag);
+        if (isSignalFrame(node))
+            metrics().alarms.inc();
+        if (isSignalFrame(node) && INSUF::isCriticalAlarm(tag) && !m_alarm) {
+            m_alarm = tag;
+            logToFile(QString("ALARM: %1").arg(QString::fromLatin1(INSUF::alarmName(tag))));
+            if (m_reply && !m_reply->m_safety)
+                m_reply->finish(false);
+            // перекрытие уже идёт — повторно его не начинаем
+            if (!m_shutOff.isRunning()) {
+                m_shutOff = shutOffOnAlarm();
+                m_shutOff.start();
             }
         }
 
-        // TODO: check CRC before accepting the frame.
+        for (const Subscription &sub: m_subscriptions) {
+            if ((sub.address == ANY || sub.address == node.address) &&
+                (sub.tag == ANY || sub.tag == tag))
+                sub.handler(node);
+        }
+    }
+
+    /**
+     * @brief Время «запрос-ответ» последнего успешного обмена (мс).
+     *
+     * Отсчитывается от отправки команды, т.е. без ожидания очереди к линии.
+     */
+    double lastRoundTripMs() const { return m_lastRttMs; }
+
+    /// Номер зафиксированной критической тревоги (0 — тревоги нет).
+    unsigned char alarm() const { return m_alarm; }
+
+    /// Сбрасывает зафиксированную тревогу перед новым запуском.
+    void clearAlarm() { m_alarm = 0; }
+
+private:
+    /// Подписка на кадры с заданным адресом и тегом.
+    struct Subscription {
+        int address;
+        int tag;
+        Handler handler;
+    };
+
+    void readyRead() override {
+        drain();
+    }
 
-        node->tag = (result[2]);
-        node->data = static_cast<uint16_t>(static_cast<uint8_t>(result[3])) |
-                     (static_cast<uint16_t>(static_cast<uint8_t>(result[4])) << 8);
+    /// Аварийное перекрытие редуктора по критической тревоге (@ref dispatch()).
+    Coro::Task<> shutOffOnAlarm() {
+        const bool closed = co_await asyncSafetyRequest<Protocol::ShutOff>();
+        if (!closed)
+            logToFile("ALARM: SHUT_OFF not acknowledged");
     }
+
+    /**
+     * @brief Разбирает все готовые кадры: ожидаемый ответ завершает
+     *        @ref Reply, остальные уходят в @ref dispatch().
+     */
+    void drain() {
+        DataNode node;
+        while (PollData(&node)) {
+            if (m_reply && m_reply->matches(node)) {
+                *m_reply->m_node = node;
+                m_reply->finish(true);
+            } else {
+                dispatch(node);
+            }
+        }
+    }
+
+    /**
+     * @brief Является ли кадр сигналом тревоги от инсуффлятора.
+     *
+     * В кадре нет поля типа, а адрес инсуффлятора совпадает с адресом
+     * регулятора, так что сигнал отличается от ответа только тегом.
+     * Ожидаемый ответ разбирается раньше (@ref drain()), а ответы всех
+     * команд протокола не попадают в диапазон тревог — это проверяет
+     * @ref Protocol::repliesDistinctFromAlarms().
+     */
+    static bool isSignalFrame(const DataNode &node) {
+        return node.address == INSUF::ADDRESS &&
+               INSUF::isAlarm(static_cast<unsigned char>(node.tag));
+    }
+
+    QVector<Subscription> m_subscriptions; ///< Активные подписки.
+    QElapsedTimer m_sentAt;                ///< Момент отправки последней команды (для RTT).
+    double m_lastRttMs = 0.0;              ///< RTT последнего успешного обмена (мс).
+    Coro::Mutex m_link;                    ///< Очередь сопрограмм к линии.
+    Reply *m_reply = nullptr;              ///< Ожидаемый ответ текущего обмена.
+    unsigned char m_alarm = 0;             ///< Зафиксированная критическая тревога.
+    Coro::Task<> m_shutOff;                ///< Аварийное перекрытие редуктора (разрушается раньше @ref m_link).
 };
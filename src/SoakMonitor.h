@@ -0,0 +1,203 @@
+/**
+ * @file SoakMonitor.h
+ * @brief Учёт циклов длительного (soak) прогона калибровки и поиск деградации.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <cmath>
+
+#include "Metrics.h"
+#include "ResourceUsage.h"
+
+/**
+ * @brief Ведёт циклы soak-прогона: сколько ещё крутить и как менялся каждый цикл.
+ *
+ * По каждому циклу записываются длительность, резидентная память,
+ * число выделений памяти за цикл, число живых блоков в конце цикла и
+ * среднее время «запрос-ответ». В сводке по каждому показателю
+ * строится прямая МНК по номеру цикла; если её прирост за весь прогон
+ * превышает порог относительно среднего, показатель помечается как
+ * ползущий (замедление или утечка). Первый цикл — прогрев, в тренд
+ * он не входит.
+ */
+class SoakMonitor {
+public:
+    /// Показатели одного цикла.
+    struct Cycle {
+        int number;              ///< Номер цикла с 1.
+        bool ok;                 ///< Калибровка завершилась успешно.
+        double seconds;          ///< Длительность цикла.
+        double rssMiB;           ///< Резидентная память в конце цикла.
+        double allocations;      ///< Вызовов operator new за цикл.
+        double liveBlocks;       ///< Невозвращённых блоков в конце цикла.
+        double rttMs;            ///< Среднее время «запрос-ответ» за цикл (NAN — не было ответов).
+    };
+
+    static constexpr int MIN_TREND_CYCLES = 4;  ///< Минимум циклов (без прогрева) для оценки тренда.
+
+    /**
+     * @brief Начинает прогон.
+     * @param cycles     Количество циклов (0 — не ограничено).
+     * @param durationMs Длительность прогона (0 — не ограничена).
+     *                   Если оба ограничения нулевые, выполняется один цикл.
+     */
+    void start(int cycles, qint64 durationMs) {
+        m_maxCycles = cycles > 0 || durationMs > 0 ? qMax(0, cycles) : 1;
+        m_durationMs = qMax<qint64>(0, durationMs);
+        m_cycles.clear();
+        m_active = true;
+        m_clock.start();
+    }
+
+    /// Прогон идёт.
+    bool isActive() const { return m_active; }
+
+    /// Завершает прогон (записанные циклы сохраняются до следующего @ref start()).
+    void stop() {
+        m_active = false;
+        m_inCycle = false;
+    }
+
+    /// Записанные циклы.
+    const QVector<Cycle> &cycles() const { return m_cycles; }
+
+    /// Идёт ли цикл (между @ref beginCycle() и @ref endCycle()).
+    bool inCycle() const { return m_inCycle; }
+
+    /// Отмечает начало очередного цикла.
+    void beginCycle() {
+        m_inCycle = true;
+        m_cycleClock.start();
+        m_allocationsBefore = ResourceUsage::allocations();
+        m_rttCountBefore = metrics().rttSeconds.count();
+        m_rttSumBefore = metrics().rttSeconds.sum();
+    }
+
+    /// Записывает закончившийся цикл.
+    const Cycle &endCycle(bool ok) {
+        const uint64_t allocations = ResourceUsage::allocations();
+        const uint64_t rttCount = metrics().rttSeconds.count() - m_rttCountBefore;
+        Cycle c;
+        c.number = m_cycles.size() + 1;
+        c.ok = ok;
+        c.seconds = m_cycleClock.elapsed() / 1000.0;
+        c.rssMiB = ResourceUsage::residentBytes() / (1024.0 * 1024.0);
+        c.allocations = double(allocations - m_allocationsBefore);
+        c.liveBlocks = double(allocations - ResourceUsage::deallocations());
+        c.rttMs = rttCount ? (metrics().rttSeconds.sum() - m_rttSumBefore) / rttCount * 1000 : NAN;
+        m_cycles.append(c);
+        m_inCycle = false;
+        return m_cycles.last();
+    }
+
+    /// Нужен ли ещё цикл по заданным ограничениям.
+    bool wantsAnotherCycle() const {
+        if (!m_active)
+            return false;
+        if (m_maxCycles > 0 && m_cycles.size() >= m_maxCycles)
+            return false;
+        return m_durationMs == 0 || m_clock.elapsed() < m_durationMs;
+    }
+
+    /// Сводка прогона для лога: итоги и ползущие показатели.
+    QStringList summary() const {
+        QStringList lines;
+        int ok = 0;
+        for (const Cycle &c: m_cycles)
+            ok += c.ok;
+        lines << QStringLiteral("Soak: %1 cycles (%2 ok) in %3 min")
+                     .arg(m_cycles.size()).arg(ok).arg(m_clock.elapsed() / 60000.0, 0, 'f', 1);
+
+        if (m_cycles.size() - 1 < MIN_TREND_CYCLES) {
+            lines << QStringLiteral("Soak: too few cycles for trend analysis");
+            return lines;
+        }
+
+        int creeping = 0;
+        auto check = [&](const char *name, double Cycle::*field, double threshold, const char *unit) {
+            double slope = 0, mean = 0;
+            if (!trend(field, &slope, &mean))
+                return;
+            const double growth = slope * (m_cycles.size() - 2);
+            const double relative = mean != 0 ? growth / std::fabs(mean) : 0;
+            const bool flagged = relative > threshold;
+            creeping += flagged;
+            lines << QStringLiteral("Soak: %1 %2 %3/cycle (%4% over run)%5")
+                         .arg(QString::fromLatin1(name))
+                         .arg(slope >= 0 ? QStringLiteral("+") : QString())
+                         .arg(slope, 0, 'g', 3)
+                         .arg(relative * 100, 0, 'f', 1)
+                         .arg(flagged ? QStringLiteral(" [CREEPING: %1]").arg(QString::fromLatin1(unit)) : QString());
+        };
+        check("duration", &Cycle::seconds, 0.10, "slowdown");
+        check("RTT", &Cycle::rttMs, 0.20, "latency drift");
+        check("RSS", &Cycle::rssMiB, 0.10, "memory growth");
+        check("live blocks", &Cycle::liveBlocks, 0.05, "possible leak");
+        check("allocations", &Cycle::allocations, 0.10, "allocation growth");
+
+        lines << (creeping ? QStringLiteral("Soak: %1 metric(s) degrade over the run").arg(creeping)
+                           : QStringLiteral("Soak: no degradation detected"));
+        return lines;
+    }
+
+    /**
+     * @brief Сохраняет циклы в CSV.
+     * @param error Куда записать описание ошибки (может быть @c nullptr).
+     */
+    bool writeCsv(const QString &path, QString *error = nullptr) const {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            if (error) *error = file.errorString();
+            return false;
+        }
+        QTextStream out(&file);
+        out << "cycle,ok,duration_s,rss_mib,allocations,live_blocks,rtt_ms\n";
+        for (const Cycle &c: m_cycles) {
+            out << c.number << ',' << (c.ok ? 1 : 0) << ',' << QString::number(c.seconds, 'f', 3) << ','
+                << QString::number(c.rssMiB, 'f', 2) << ',' << qint64(c.allocations) << ','
+                << qint64(c.liveBlocks) << ',' << (std::isnan(c.rttMs) ? QString() : QString::number(c.rttMs, 'f', 3))
+                << '\n';
+        }
+        return true;
+    }
+
+private:
+    /// Наклон прямой МНК «показатель от номера цикла» без цикла прогрева.
+    bool trend(double Cycle::*field, double *slope, double *mean) const {
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (int i = 1; i < m_cycles.size(); ++i) {
+            const double y = m_cycles[i].*field;
+            if (std::isnan(y))
+                continue;
+            n += 1;
+            sx += i;
+            sy += y;
+            sxx += double(i) * i;
+            sxy += i * y;
+        }
+        const double d = n * sxx - sx * sx;
+        if (n < MIN_TREND_CYCLES || d == 0)
+            return false;
+        *slope = (n * sxy - sx * sy) / d;
+        *mean = sy / n;
+        return true;
+    }
+
+    bool m_active = false;          ///< Прогон идёт.
+    bool m_inCycle = false;         ///< Цикл начат и ещё не записан.
+    int m_maxCycles = 1;            ///< Предел по числу циклов (0 — нет).
+    qint64 m_durationMs = 0;        ///< Предел по времени (0 — нет).
+    QElapsedTimer m_clock;          ///< Время с начала прогона.
+    QElapsedTimer m_cycleClock;     ///< Время с начала цикла.
+    uint64_t m_allocationsBefore = 0; ///< Счётчик выделений в начале цикла.
+    uint64_t m_rttCountBefore = 0;  ///< Ответов в начале цикла.
+    double m_rttSumBefore = 0;      ///< Сумма RTT в начале цикла, с.
+    QVector<Cycle> m_cycles;        ///< Записанные циклы.
+};
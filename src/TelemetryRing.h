@@ -0,0 +1,289 @@
+/**
+ * @file TelemetryRing.h
+ * @brief Кольцевой буфер телеметрии в разделяемой памяти для локальных процессов.
+ *
+ * Один писатель (@ref TelemetryWriter в приложении) публикует каждое
+ * измерение расхода (с частотой опроса канала, 20 Гц) в кольцо
+ * фиксированного формата, любое число читателей
+ * (@ref TelemetryReader — в дашбордах, логгерах) забирают поток без
+ * разбора текста, сокетов и блокировок. Писатель никогда не ждёт
+ * читателей: отставший читатель теряет самые старые записи и узнаёт
+ * об этом по счётчику @ref TelemetryReader::dropped().
+ *
+ * Разделяемая память создаётся через QSharedMemory (POSIX shm на Unix,
+ * file mapping на Windows) под платформенным именем @ref Telemetry::key()
+ * без хеширования Qt, поэтому читатель не обязан быть Qt-программой:
+ * @code
+ * // Linux/macOS                              // Windows
+ * int fd = shm_open("/valve-tuner-telemetry-ttyUSB0", O_RDONLY, 0);
+ * void *p = mmap(nullptr, SIZE, PROT_READ, MAP_SHARED, fd, 0);
+ *                                             HANDLE h = OpenFileMappingW(FILE_MAP_READ, FALSE,
+ *                                                 L"valve-tuner-telemetry-COM3");
+ *                                             void *p = MapViewOfFile(h, FILE_MAP_READ, 0, 0, SIZE);
+ * @endcode
+ * Дальше — разбор @ref Telemetry::Header и слотов, как в @ref TelemetryReader.
+ */
+
+#pragma once
+
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QNativeIpcKey>
+#include <QSharedMemory>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+namespace Telemetry {
+    constexpr uint32_t MAGIC = 0x4D4C5456;  ///< "VTLM" в little-endian.
+    constexpr uint16_t VERSION = 1;         ///< Версия формата записи.
+    constexpr uint32_t CAPACITY = 4096;     ///< Количество слотов кольца.
+
+    /// Флаги поля @ref Sample::status (младший байт).
+    enum StatusFlags : uint32_t {
+        RUNNING = 1u << 0,  ///< Идёт настройка.
+        VALVE_ON = 1u << 1, ///< Клапан открыт.
+    };
+
+    /**
+     * @brief Одно измерение. Формат фиксирован для версии @ref VERSION.
+     *
+     * Поле @c status: биты 0..7 — @ref StatusFlags, 8..15 — код
+     * критической тревоги (0 — нет), 16..31 — индекс уставки плана.
+     * Ошибка, давление, температура и PWM — последние на момент записи
+     * расхода: регулятор обновляет их раз за тик (100 мс).
+     */
+    struct Sample {
+        int64_t timestampUs;  ///< Время UTC, мкс от эпохи Unix.
+        float flow;           ///< Расход, л/мин.
+        float error;          ///< Ошибка регулирования, л/мин.
+        float pressure;       ///< Давление инсуффляции, мм рт. ст.
+        float temperature;    ///< Температура, °C.
+        int32_t pwm;          ///< PWM клапана.
+        uint32_t status;      ///< Состояние (см. выше).
+    };
+    static_assert(sizeof(Sample) == 32, "telemetry record layout changed");
+
+    /// Слот кольца: запись под защитой счётчика-последовательности (seqlock).
+    struct Slot {
+        std::atomic<uint64_t> seq; ///< 2n+1 — запись n пишется, 2n+2 — запись n готова.
+        Sample sample;
+    };
+    static_assert(sizeof(Slot) == 40, "telemetry slot layout changed");
+
+    /// Заголовок области разделяемой памяти.
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t capacity;
+        uint32_t reserved;
+        std::atomic<uint64_t> head; ///< Количество опубликованных записей.
+    };
+    static_assert(sizeof(Header) == 24, "telemetry header layout changed");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock-free atomics");
+
+    /// Размер области разделяемой памяти.
+    constexpr int SIZE = sizeof(Header) + CAPACITY * sizeof(Slot);
+
+    /**
+     * @brief Платформенное имя области для тюнера на заданном порту.
+     *
+     * Для порта берётся только имя устройства (@c /dev/ttyUSB0 → @c ttyUSB0).
+     * На Unix это имя объекта POSIX shm (с ведущим @c /), на Windows — имя
+     * file mapping.
+     */
+    inline QString key(const QString &portName) {
+        const QString name = QStringLiteral("valve-tuner-telemetry-") + QFileInfo(portName).fileName();
+#ifdef Q_OS_WIN
+        return name;
+#else
+        return QLatin1Char('/') + name;
+#endif
+    }
+
+    /// Файл блокировки, которым живой писатель закрепляет за собой область @p key.
+    inline QString ownerLockPath(const QString &key) {
+        return QDir::temp().filePath(QFileInfo(key).fileName() + QStringLiteral(".lock"));
+    }
+
+    inline Header *header(void *base) {
+        return static_cast<Header *>(base);
+    }
+
+    inline Slot *slotArray(void *base) {
+        return reinterpret_cast<Slot *>(static_cast<char *>(base) + sizeof(Header));
+    }
+}
+
+/**
+ * @brief Писатель кольца телеметрии (единственный на ключ).
+ */
+class TelemetryWriter {
+public:
+    /**
+     * @brief Создаёт (или переинициализирует оставшуюся после сбоя) область памяти.
+     *
+     * Пока писатель жив, он держит файл блокировки @ref Telemetry::ownerLockPath().
+     * Если блокировку держит другой процесс, область не трогается и
+     * писатель остаётся недоступным; блокировку умершего процесса
+     * QLockFile снимает сам, и его область переинициализируется.
+     * @param key Платформенное имя области, см. @ref Telemetry::key().
+     */
+    explicit TelemetryWriter(const QString &key)
+        : m_shm(QNativeIpcKey(key)), m_owner(Telemetry::ownerLockPath(key)) {
+        if (!m_owner.tryLock(0)) {
+            m_error = QStringLiteral("telemetry area %1 is owned by another process").arg(key);
+            return;
+        }
+        if (!m_shm.create(Telemetry::SIZE)) {
+            if (m_shm.error() != QSharedMemory::AlreadyExists || !m_shm.attach())
+                return;
+            if (m_shm.size() < Telemetry::SIZE) {
+                m_shm.detach();
+                return;
+            }
+        }
+
+        void *base = m_shm.data();
+        std::memset(base, 0, Telemetry::SIZE);
+        Telemetry::Header *h = new(base) Telemetry::Header{};
+        h->magic = Telemetry::MAGIC;
+        h->version = Telemetry::VERSION;
+        h->recordSize = sizeof(Telemetry::Sample);
+        h->capacity = Telemetry::CAPACITY;
+        h->head.store(0, std::memory_order_relaxed);
+
+        Telemetry::Slot *s = Telemetry::slotArray(base);
+        for (uint32_t i = 0; i < Telemetry::CAPACITY; ++i)
+            new(&s[i].seq) std::atomic<uint64_t>(0);
+
+        m_header = h;
+        m_slots = s;
+    }
+
+    /// @c true, если область памяти доступна и публикация работает.
+    bool isValid() const { return m_header != nullptr; }
+
+    /// Текст ошибки создания области.
+    QString errorString() const { return m_error.isEmpty() ? m_shm.errorString() : m_error; }
+
+    /**
+     * @brief Публикует измерение. Не блокируется и не выделяет память.
+     */
+    void publish(const Telemetry::Sample &sample) {
+        if (!m_header)
+            return;
+
+        const uint64_t n = m_next++;
+        Telemetry::Slot &slot = m_slots[n % Telemetry::CAPACITY];
+        slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.sample = sample;
+        slot.seq.store(2 * n + 2, std::memory_order_release);
+        m_header->head.store(n + 1, std::memory_order_release);
+    }
+
+private:
+    QSharedMemory m_shm;                     ///< Область разделяемой памяти.
+    QLockFile m_owner;                       ///< Блокировка владельца области.
+    QString m_error;                         ///< Ошибка, не связанная с QSharedMemory.
+    Telemetry::Header *m_header = nullptr;   ///< Заголовок (nullptr — область недоступна).
+    Telemetry::Slot *m_slots = nullptr;      ///< Слоты кольца.
+    uint64_t m_next = 0;                     ///< Номер следующей записи.
+};
+
+/**
+ * @brief Читатель кольца телеметрии (для сторонних локальных процессов).
+ *
+ * Пример:
+ * @code
+ * TelemetryReader reader(Telemetry::key("COM3"));
+ * Telemetry::Sample buf[256];
+ * for (;;) {
+ *     const int n = reader.read(buf, 256);
+ *     ...
+ * }
+ * @endcode
+ */
+class TelemetryReader {
+public:
+    /**
+     * @brief Подключается к области только для чтения и проверяет формат.
+     * @param key Платформенное имя области, см. @ref Telemetry::key().
+     * @param fromStart @c true — начать с самой старой доступной записи,
+     *                  иначе — только новые записи.
+     */
+    explicit TelemetryReader(const QString &key, bool fromStart = false) : m_shm(QNativeIpcKey(key)) {
+        if (!m_shm.attach(QSharedMemory::ReadOnly) || m_shm.size() < Telemetry::SIZE)
+            return;
+
+        void *base = const_cast<void *>(m_shm.constData());
+        Telemetry::Header *h = Telemetry::header(base);
+        if (h->magic != Telemetry::MAGIC || h->version != Telemetry::VERSION ||
+            h->recordSize != sizeof(Telemetry::Sample) || h->capacity != Telemetry::CAPACITY)
+            return;
+
+        m_header = h;
+        m_slots = Telemetry::slotArray(base);
+        const uint64_t head = h->head.load(std::memory_order_acquire);
+        if (!fromStart)
+            m_cursor = head;
+        else if (head > Telemetry::CAPACITY)
+            m_cursor = head - Telemetry::CAPACITY;
+    }
+
+    /// @c true, если область найдена и формат совпадает.
+    bool isValid() const { return m_header != nullptr; }
+
+    /**
+     * @brief Забирает новые записи.
+     * @param out Буфер для записей.
+     * @param max Размер буфера.
+     * @return Количество прочитанных записей.
+     */
+    int read(Telemetry::Sample *out, int max) {
+        if (!m_header)
+            return 0;
+
+        const uint64_t head = m_header->head.load(std::memory_order_acquire);
+        if (head < m_cursor)
+            m_cursor = 0; // писатель перезапущен и начал нумерацию заново
+        if (head - m_cursor > Telemetry::CAPACITY) {
+            m_dropped += head - Telemetry::CAPACITY - m_cursor;
+            m_cursor = head - Telemetry::CAPACITY;
+        }
+
+        int count = 0;
+        while (m_cursor < head && count < max) {
+            const uint64_t n = m_cursor;
+            const Telemetry::Slot &slot = m_slots[n % Telemetry::CAPACITY];
+            const uint64_t before = slot.seq.load(std::memory_order_acquire);
+            Telemetry::Sample copy = slot.sample;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after = slot.seq.load(std::memory_order_relaxed);
+
+            ++m_cursor;
+            if (before != 2 * n + 2 || after != before) {
+                // писатель уже перезаписал слот — запись потеряна
+                ++m_dropped;
+                continue;
+            }
+            out[count++] = copy;
+        }
+        return count;
+    }
+
+    /// Сколько записей потеряно из-за отставания читателя.
+    uint64_t dropped() const { return m_dropped; }
+
+private:
+    QSharedMemory m_shm;                     ///< Область разделяемой памяти.
+    Telemetry::Header *m_header = nullptr;   ///< Заголовок (nullptr — область недоступна).
+    const Telemetry::Slot *m_slots = nullptr; ///< Слоты кольца.
+    uint64_t m_cursor = 0;                   ///< Номер следующей читаемой записи.
+    uint64_t m_dropped = 0;                  ///< Потерянные записи.
+};
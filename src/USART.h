@@ -7,19 +7,52 @@
 
 #include <QSerialPort>
 #include <QElapsedTimer>
-#include <QThread>
 #include <QDir>
 #include <QDateTime>
 
 /**
  * @brief Низкоуровневая обёртка UART на базе QSerialPort.
  *
- * Предоставляет базовые операции открытия/закрытия порта, блокирующей
- * передачи/приёма фиксированного пакета и примитивное логирование
- * в текстовый файл.
+ * Предоставляет базовые операции открытия/закрытия порта, неблокирующей
+ * передачи/приёма фиксированного пакета и примитивное логирование в
+ * текстовый файл. Поток порт не задерживает (кроме короткой дозаписи
+ * при закрытии): ожидание ответа организуют сопрограммы
+ * (@ref Data::asyncWaitReply()).
  */
 class UART {
+public:
+    /**
+     * @brief Получатель уведомлений о приходе данных для неблокирующего приёма.
+     *
+     * Уведомление приходит из цикла событий; сам кадр забирается
+     * через @ref pollUART().
+     */
+    class Listener {
+    public:
+        virtual void readyRead() = 0;
+
+    protected:
+        ~Listener() = default;
+    };
+
+    /// Служебные байты кадрирующего протокола (SLIP).
+    enum {
+        FEND = 0xC0,  ///< Frame End: начало кадра.
+        FESC = 0xDB,  ///< Frame Escape.
+        TFEND = 0xDC, ///< Transposed Frame End: FESC TFEND заменяет FEND внутри кадра.
+        TFESC = 0xDD, ///< Transposed Frame Escape: FESC TFESC заменяет FESC.
+    };
+
+    static constexpr int PACKET_SIZE = 6;     ///< Длина кадра без экранирования: FEND, адрес, тег, 2 байта данных, CRC.
+    static constexpr int MAX_WAIT_MS = 1000;  ///< Тайм-аут ожидания кадра (мс).
+    static constexpr int CLOSE_FLUSH_MS = 100; ///< Сколько закрытие порта ждёт передачи очереди (мс).
+    static constexpr qint64 LOG_MAX_BYTES = 32 << 20; ///< Размер debug.log, после которого он ротируется.
+    static constexpr int LOG_BACKUPS = 3;     ///< Сколько прежних журналов хранится (debug.log.1 — новейший).
+
+private:
     QSerialPort m_serialPort;
+    QByteArray m_rxBuffer; ///< Принятые, но ещё не разобранные байты (хвост после кадра).
+    Listener *m_listener = nullptr; ///< Ожидающий данных неблокирующий приём.
 
 public:
     /**
@@ -34,74 +67,137 @@ public:
         m_serialPort.setDataBits(QSerialPort::Data8);
         m_serialPort.setRequestToSend(true);
         m_serialPort.setDataTerminalReady(true);
+        QObject::connect(&m_serialPort, &QSerialPort::readyRead, [this] { notifyReadyRead(); });
     };
 
+    /// Операции порта виртуальные: их подменяет имитатор (@ref SimulatedUART).
+    virtual ~UART() = default;
+
     /**
      * @brief Открывает последовательный порт.
      * @param mode Режим открытия Qt (чтение/запись или оба).
      * @return @c true при успешном открытии, @c false при ошибке.
      */
-    bool initUART(QSerialPort::OpenMode mode = QIODevice::ReadWrite) {
+    virtual bool initUART(QSerialPort::OpenMode mode = QIODevice::ReadWrite) {
         return m_serialPort.open(mode);
     }
 
     /**
-     * @brief Передаёт массив байт в последовательный порт и логирует его.
+     * @brief Ставит массив байт в очередь передачи, не дожидаясь отправки.
      * @param data Буфер, который необходимо отправить.
      */
-    void transmitUART(QByteArray &data) {
+    virtual void writeUART(QByteArray &data) {
         m_serialPort.write(data);
-        m_serialPort.waitForBytesWritten(100);
         logUARTData("WRITING", data);
     }
 
     /**
-     * @brief Принимает один пакет фиксированного размера из порта.
+     * @brief Неблокирующий приём: кадр, если он уже пришёл целиком.
      *
-     * Читает данные до PACKET_SIZE байт или до истечения тайм-аута,
-     * логирует всё, что прочитано. Если первый байт кадра равен 0xC0,
-     * возвращает первые PACKET_SIZE байт, иначе возвращает пустой массив.
+     * Забирает всё, что есть в порту, и возвращает очередной кадр из
+     * буфера приёма (см. @ref takeFrame()) или пустой массив. Байты,
+     * пришедшие следом за кадром (например, незапрошенный кадр тревоги),
+     * остаются в буфере до следующего вызова. Ожидание организует
+     * вызывающий через @ref setListener().
      */
-    QByteArray recieveUART() {
-        QByteArray data;
-        const int PACKET_SIZE = 6;
-        const int MAX_WAIT_MS = 1000;
-        // serialPort.clear();
-
-        QElapsedTimer timer;
-        timer.start();
-
-        while (timer.elapsed() < MAX_WAIT_MS && data.size() < PACKET_SIZE) {
-            if (m_serialPort.waitForReadyRead(1000)) {
-                data.append(m_serialPort.readAll());
-                //data = serialPort.readAll();
-                logUARTData("READING", data);
-            }
-            QThread::msleep(1);
+    virtual QByteArray pollUART() {
+        if (m_serialPort.bytesAvailable() > 0) {
+            const QByteArray chunk = m_serialPort.readAll();
+            logUARTData("READING", chunk);
+            m_rxBuffer.append(chunk);
         }
-        if (data.size() >= PACKET_SIZE && static_cast<quint8>(data[0]) == 0xC0) {
-            return data.left(PACKET_SIZE);
+        return takeFrame(&m_rxBuffer);
+    }
+
+    /**
+     * @brief Выделяет из буфера приёма очередной кадр с учётом экранирования.
+     *
+     * Кадр начинается с FEND и заканчивается, когда после снятия
+     * экранирования набрано @ref PACKET_SIZE байт; пара FESC TFEND или
+     * FESC TFESC считается за один байт. Байты до начала кадра
+     * отбрасываются. FEND внутри кадра начинает новый кадр, а FESC,
+     * за которым нет TFEND или TFESC, отбрасывает начатый: такой кадр
+     * повреждён. Длину и CRC кадра проверяет @ref Data::decodeFrame().
+     * @return Кадр в том виде, как он пришёл (с экранированием), или
+     *         пустой массив, если он ещё не пришёл целиком.
+     */
+    static QByteArray takeFrame(QByteArray *buffer) {
+        for (;;) {
+            const int start = buffer->indexOf(static_cast<char>(FEND));
+            if (start < 0) {
+                buffer->clear();
+                return QByteArray();
+            }
+            buffer->remove(0, start);
+
+            int unstuffed = 1;
+            int i = 1;
+            int restart = 0;
+            while (unstuffed < PACKET_SIZE && i < buffer->size()) {
+                const unsigned char b = static_cast<unsigned char>(buffer->at(i));
+                if (b == FEND) {
+                    restart = i;
+                    break;
+                }
+                if (b == FESC) {
+                    if (i + 1 == buffer->size())
+                        return QByteArray();    // пара FESC ещё не пришла целиком
+                    const unsigned char next = static_cast<unsigned char>(buffer->at(i + 1));
+                    if (next != TFEND && next != TFESC) {
+                        restart = i + 1;
+                        break;
+                    }
+                    ++i;
+                }
+                ++i;
+                ++unstuffed;
+            }
+
+            if (restart) {
+                buffer->remove(0, restart);
+                continue;
+            }
+            if (unstuffed < PACKET_SIZE)
+                return QByteArray();
+            const QByteArray frame = buffer->left(i);
+            buffer->remove(0, i);
+            return frame;
         }
-        return QByteArray();
     }
 
+    /// Назначает получателя уведомлений о приходе данных (@c nullptr — снять).
+    void setListener(Listener *listener) { m_listener = listener; }
+
     /**
      * @brief Закрывает последовательный порт.
+     *
+     * Закрытие отбрасывает не переданные байты, поэтому очередь передачи
+     * сначала дописывается — не дольше @ref CLOSE_FLUSH_MS.
      */
-    void closeUART() {
+    virtual void closeUART() {
+        if (m_serialPort.bytesToWrite() > 0)
+            m_serialPort.waitForBytesWritten(CLOSE_FLUSH_MS);
         m_serialPort.close();
+        m_rxBuffer.clear();
     }
 
     /**
      * @brief Добавляет одну строку в файл @c debug.log с временной меткой.
+     *
+     * Метка с миллисекундами: по ней офлайн-анализ (@c valve-log-analyzer)
+     * восстанавливает время «запрос-ответ». Файл больше @ref LOG_MAX_BYTES
+     * переименовывается в debug.log.1 (прежние сдвигаются, старейший
+     * сверх @ref LOG_BACKUPS удаляется), и запись начинается заново.
      * @param message Текст сообщения для записи.
      */
     static void logToFile(const QString &message) {
         QFile file("debug.log");
+        if (file.size() > LOG_MAX_BYTES)
+            rotateLog(&file);
 
         if (file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
             QTextStream stream(&file);
-            QString timestamp = QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss");
+            QString timestamp = QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss.zzz");
             stream << timestamp << " - " << message << "\n";
             file.close();
         }
@@ -135,4 +231,23 @@ public:
         QString message = QString("%1: %2").arg(prefix).arg(value, 0, 'f', 2);
         logToFile(message);
     }
+
+protected:
+    /// Сообщает ожидающему приёму, что пришли данные.
+    void notifyReadyRead() {
+        if (m_listener)
+            m_listener->readyRead();
+    }
+
+private:
+    /// Сдвигает debug.log.N → debug.log.N+1 и переименовывает @p file в debug.log.1.
+    static void rotateLog(QFile *file) {
+        const QString name = file->fileName();
+        QFile::remove(QStringLiteral("%1.%2").arg(name).arg(LOG_BACKUPS));
+        for (int i = LOG_BACKUPS - 1; i >= 1; --i)
+            QFile::rename(QStringLiteral("%1.%2").arg(name).arg(i), QStringLiteral("%1.%2").arg(name).arg(i + 1));
+        if (!file->rename(name + QStringLiteral(".1")))
+            file->remove();
+        file->setFileName(name);
+    }
 };
@@ -0,0 +1,164 @@
+/**
+ * @file ValveSimulator.h
+ * @brief Имитатор устройства на месте последовательного порта для прогонов без стенда.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QVector>
+
+#include <cmath>
+
+#include "USART.h"
+#include "orders.h"
+
+/**
+ * @brief UART, за которым вместо устройства стоит модель клапана.
+ *
+ * Выбирается именем порта @ref portName() ("SIM"). Отвечает на все
+ * команды протокола, которые посылает @ref Insufflator, тем же тегом;
+ * расход подчиняется апериодическому звену первого порядка:
+ * пока подача включена (ON_FLOW) и клапан открыт (SET_SHIM), расход
+ * стремится к (ZERO_FLOW_PWM - PWM) / PWM_PER_FLOW, после SHUT_OFF — к нулю.
+ * Обмен пишется в @c debug.log так же, как для настоящего порта.
+ * Ответ становится доступен через @ref LATENCY_US после команды,
+ * о чём, как и настоящий порт, сообщает уведомление о приходе данных.
+ */
+class SimulatedUART : public UART {
+public:
+    static constexpr double ZERO_FLOW_PWM = 3100;  ///< PWM, при котором расход нулевой.
+    static constexpr double PWM_PER_FLOW = 40;     ///< Снижение PWM на 1 л/мин расхода.
+    static constexpr double TAU_S = 0.3;           ///< Постоянная времени клапана, с.
+    static constexpr double NOISE_LPM = 0.03;      ///< Амплитуда шума измерения расхода.
+    static constexpr int LATENCY_US = 1000;        ///< Задержка ответа, мкс.
+
+    /// Имя порта, выбирающее имитатор.
+    static QString portName() { return QStringLiteral("SIM"); }
+
+    explicit SimulatedUART(const QString &Portname) : UART(Portname) {
+        m_notify.setSingleShot(true);
+        m_notify.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&m_notify, &QTimer::timeout, [this] { notifyReadyRead(); });
+    }
+
+    bool initUART(QSerialPort::OpenMode = QIODevice::ReadWrite) override {
+        m_clock.start();
+        return true;
+    }
+
+    void closeUART() override {
+        m_notify.stop();
+        m_replies.clear();
+    }
+
+    void writeUART(QByteArray &data) override {
+        logUARTData("WRITING", data);
+        const QByteArray frame = unstuff(data);
+        if (frame.size() < 5)
+            return;
+        advance();
+        handle(static_cast<uchar>(frame[1]), static_cast<uchar>(frame[2]),
+               static_cast<uint16_t>(static_cast<uchar>(frame[3]) | static_cast<uchar>(frame[4]) << 8));
+        m_notify.start(LATENCY_US / 1000);
+    }
+
+    QByteArray pollUART() override {
+        if (m_replies.isEmpty())
+            return QByteArray();
+        const qint64 leftUs = LATENCY_US - m_clock.nsecsElapsed() / 1000;
+        if (leftUs > 0) {
+            // уведомление пришло раньше задержки ответа — ждём остаток
+            m_notify.start(int((leftUs + 999) / 1000));
+            return QByteArray();
+        }
+        const QByteArray reply = m_replies.takeFirst();
+        logUARTData("READING", reply);
+        return reply;
+    }
+
+private:
+    /// Продвигает модель клапана на время, прошедшее с прошлой команды.
+    void advance() {
+        const double dt = m_clock.nsecsElapsed() / 1e9;
+        m_clock.restart();
+        const double target = m_flowOn && m_valveOpen ? qMax(0.0, (ZERO_FLOW_PWM - m_pwm) / PWM_PER_FLOW) : 0.0;
+        m_flow += (target - m_flow) * (1 - std::exp(-dt / TAU_S));
+    }
+
+    void handle(uchar address, uchar command, uint16_t value) {
+        uint16_t reply = 0;
+        if (address == REDUC::ADDRESS) {
+            switch (command) {
+                case REDUC::ON_FLOW: m_flowOn = true; break;
+                case REDUC::OFF_FLOW: m_flowOn = false; break;
+                case REDUC::SET_SHIM: m_pwm = value; m_valveOpen = true; break;
+                case REDUC::SHUT_OFF: m_valveOpen = false; break;
+                default: break;
+            }
+        } else if (address == REGUL::ADDRESS) {
+            switch (command) {
+                case REGUL::GET_MSR_FLOW: {
+                    const double noise = (QRandomGenerator::global()->generateDouble() * 2 - 1) * NOISE_LPM;
+                    reply = static_cast<uint16_t>(qMax(0L, std::lround((m_flow + noise) * 100)));
+                    break;
+                }
+                case REGUL::GET_MSR_PRES: reply = 150; break;    // 15.0 мм рт. ст.
+                case REGUL::GET_RDC_PRES: reply = 300; break;    // 30.0 мм рт. ст.
+                case REGUL::GET_TEMPERATURE: reply = 74; break;  // 37 °C
+                default: break;
+            }
+        }
+        m_replies.append(frame(address, command, reply));
+    }
+
+    /// Кадр ответа с CRC-8 и байт-стаффингом, как у устройства.
+    static QByteArray frame(uchar address, uchar tag, uint16_t value) {
+        const uchar raw[5] = {0xC0, address, tag, static_cast<uchar>(value & 0xFF), static_cast<uchar>(value >> 8)};
+        uchar crc = 0xDE;
+        for (uchar b: raw) {
+            crc ^= b;
+            for (int i = 0; i < 8; ++i)
+                crc = (crc & 1) ? (crc >> 1) ^ 0x8c : crc >> 1;
+        }
+
+        QByteArray out;
+        out.append(static_cast<char>(0xC0));
+        auto put = [&out](uchar b) {
+            if (b == 0xC0)
+                out.append(static_cast<char>(0xDB)).append(static_cast<char>(0xDC));
+            else if (b == 0xDB)
+                out.append(static_cast<char>(0xDB)).append(static_cast<char>(0xDD));
+            else
+                out.append(static_cast<char>(b));
+        };
+        for (int i = 1; i < 5; ++i)
+            put(raw[i]);
+        put(crc);
+        return out;
+    }
+
+    static QByteArray unstuff(const QByteArray &data) {
+        QByteArray out;
+        for (int i = 0; i < data.size(); ++i) {
+            const uchar b = static_cast<uchar>(data[i]);
+            if (b == 0xDB && i + 1 < data.size()) {
+                const uchar next = static_cast<uchar>(data[++i]);
+                out.append(static_cast<char>(next == 0xDC ? 0xC0 : next == 0xDD ? 0xDB : next));
+            } else {
+                out.append(static_cast<char>(b));
+            }
+        }
+        return out;
+    }
+
+    QElapsedTimer m_clock;        ///< Время с последней команды.
+    QTimer m_notify;              ///< Уведомление о готовности ответа.
+    QVector<QByteArray> m_replies; ///< Ответы, ещё не прочитанные хостом.
+    double m_flow = 0;            ///< Текущий расход модели, л/мин.
+    int m_pwm = 0;                ///< Последний установленный PWM.
+    bool m_flowOn = false;        ///< Подача газа включена.
+    bool m_valveOpen = false;     ///< Клапан открыт импульсом.
+};
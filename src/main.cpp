@@ -6,13 +6,25 @@
  * логики @ref Controller и QML-движок. Объект контроллера
  * пробрасывается в QML под именем контекстного свойства @c controller,
  * после чего загружается главный QML-файл модуля @c ValveTuner.
+ *
+ * Опционально (ключ @c --metrics-port или переменная окружения
+ * @c VALVE_TUNER_METRICS_PORT) на 127.0.0.1 поднимается HTTP-эндпоинт
+ * метрик Prometheus, см. @ref MetricsServer.
+ *
+ * Для длительных прогонов без участия оператора: @c --port подключает
+ * порт при старте (@c SIM — имитатор клапана), @c --soak-cycles и
+ * @c --soak-minutes запускают soak-прогон, см. @ref Controller::startSoak().
+ * @c --profile выбирает JSON-профиль плана калибровки (его же можно
+ * сменить в интерфейсе).
  */
 
+#include <QCommandLineParser>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 
 #include "Controller.h"
+#include "MetricsServer.h"
 
 /**
  * @brief Точка входа в программу.
@@ -23,7 +35,47 @@
 int main(int argc, char *argv[]) {
     QGuiApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption metricsPortOption(
+        QStringLiteral("metrics-port"),
+        QStringLiteral("Serve Prometheus metrics on 127.0.0.1:<port>/metrics."),
+        QStringLiteral("port"),
+        qEnvironmentVariable("VALVE_TUNER_METRICS_PORT"));
+    parser.addOption(metricsPortOption);
+    QCommandLineOption portOption(
+        QStringLiteral("port"),
+        QStringLiteral("Connect to <name> on startup (SIM for the valve simulator)."),
+        QStringLiteral("name"));
+    parser.addOption(portOption);
+    QCommandLineOption soakCyclesOption(
+        QStringLiteral("soak-cycles"),
+        QStringLiteral("Repeat the calibration <n> times (requires --port)."),
+        QStringLiteral("n"), QStringLiteral("0"));
+    parser.addOption(soakCyclesOption);
+    QCommandLineOption soakMinutesOption(
+        QStringLiteral("soak-minutes"),
+        QStringLiteral("Repeat the calibration for <minutes> (requires --port)."),
+        QStringLiteral("minutes"), QStringLiteral("0"));
+    parser.addOption(soakMinutesOption);
+    QCommandLineOption profileOption(
+        QStringLiteral("profile"),
+        QStringLiteral("Calibration plan profile (default: calibration.json next to the program)."),
+        QStringLiteral("file"));
+    parser.addOption(profileOption);
+    parser.process(app);
+
+    MetricsServer metricsServer;
+    const quint16 metricsPort = parser.value(metricsPortOption).toUShort();
+    if (metricsPort && !metricsServer.listen(metricsPort))
+        qWarning("Metrics endpoint disabled: %s", qPrintable(metricsServer.errorString()));
+
     Controller controller;
+    // окно закрыто — сначала подача отключается с подтверждением, потом выход
+    app.setQuitOnLastWindowClosed(false);
+    QObject::connect(&app, &QGuiApplication::lastWindowClosed, &controller, &Controller::quit);
+    if (parser.isSet(profileOption))
+        controller.setProfilePath(parser.value(profileOption));
 
     QQmlApplicationEngine engine;
     engine.rootContext()->setContextProperty(
@@ -31,5 +83,15 @@ int main(int argc, char *argv[]) {
 
     engine.loadFromModule("ValveTuner", "Main");
 
+    if (parser.isSet(portOption)) {
+        controller.setPortName(parser.value(portOption));
+        controller.connectOrDisconnect();
+
+        const int soakCycles = parser.value(soakCyclesOption).toInt();
+        const int soakMinutes = parser.value(soakMinutesOption).toInt();
+        if (soakCycles > 0 || soakMinutes > 0)
+            controller.startSoak(soakCycles, soakMinutes);
+    }
+
     return app.exec();
 }
@@ -55,6 +55,38 @@ namespace INSUF {
         ALARM_OVERHEATING_SIG,
         ALARM_HEATER_BREAK_SIG,
     };
+
+    // Сигналы приходят незапрошенными кадрами с адреса INSUF::ADDRESS,
+    // номер сигнала передаётся в байте команды. Поля типа кадра нет, а
+    // INSUF::ADDRESS == REGUL::ADDRESS: REGUL::GET_MSR_DATA и GET_RDC_DATA
+    // совпадают с ALARM_NO_CO2_SIG и ALARM_PINCH_SIG, поэтому ответы этих
+    // команд неотличимы от тревог (см. Protocol::repliesDistinctFromAlarms).
+
+    constexpr bool isAlarm(unsigned char sig) {
+        return (sig >= ALARM_NO_CO2_SIG && sig <= ALARM_BLEED_VALVE_SIG) ||
+               sig == ALARM_OVERHEATING_SIG || sig == ALARM_HEATER_BREAK_SIG;
+    }
+
+    // тревоги, при которых подачу газа нужно перекрыть немедленно
+    constexpr bool isCriticalAlarm(unsigned char sig) {
+        return isAlarm(sig) && sig != ALARM_BLEED_SIG;
+    }
+
+    inline const char *alarmName(unsigned char sig) {
+        switch (sig) {
+            case ALARM_NO_CO2_SIG: return "NO_CO2";
+            case ALARM_PINCH_SIG: return "PINCH";
+            case ALARM_BLEED_SIG: return "BLEED";
+            case ALARM_BREAK_SIG: return "BREAK";
+            case ALARM_HIPRES_SIG: return "HIPRES";
+            case ALARM_NEG_PRES_SIG: return "NEG_PRES";
+            case ALARM_SLAVE_FAULT_SIG: return "SLAVE_FAULT";
+            case ALARM_BLEED_VALVE_SIG: return "BLEED_VALVE";
+            case ALARM_OVERHEATING_SIG: return "OVERHEATING";
+            case ALARM_HEATER_BREAK_SIG: return "HEATER_BREAK";
+            default: return "UNKNOWN";
+        }
+    }
 }
 
 
@@ -0,0 +1,91 @@
+/**
+ * @file coawait-in-condition.cpp
+ * @brief Минимальный пример ошибки GCC 12.2: @c co_await в условии @c if.
+ *
+ * Сопрограмма, у которой результат @c co_await проверяется прямо в
+ * условии @c if, после возобновления не выполняет ни одного оператора
+ * тела — даже стоящего до @c if — и не завершается. Тот же код с
+ * результатом, сохранённым в переменную, работает. Поэтому в проекте
+ * результат @c co_await сначала сохраняется (см. @ref Coroutine.h).
+ *
+ * Пример не зависит от Qt и не входит в сборку:
+ * @code
+ *   g++ -std=c++20 coawait-in-condition.cpp && ./a.out
+ * @endcode
+ * Исправный компилятор печатает "decl: ok" и "if: ok" и возвращает 0;
+ * GCC 12.2.0 (Debian 12.2.0-14) печатает "if: body skipped" и возвращает 1.
+ */
+
+#include <coroutine>
+#include <cstdio>
+
+struct Task {
+    struct promise_type {
+        bool value = false;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct Final {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                const std::coroutine_handle<> c = h.promise().continuation;
+                return c ? c : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        Final final_suspend() noexcept { return {}; }
+
+        void return_value(bool v) { value = v; }
+        void unhandled_exception() {}
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(const Task &) = delete;
+    ~Task() { if (handle) handle.destroy(); }
+
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+        bool await_ready() { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+            handle.promise().continuation = caller;
+            return handle;
+        }
+        bool await_resume() { return handle.promise().value; }
+    };
+    Awaiter operator co_await() && { return Awaiter{handle}; }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+static bool bodyRan = false;
+
+Task inner() { co_return true; }
+
+Task viaDecl() {
+    bodyRan = true;
+    const bool ok = co_await inner();
+    if (ok) co_return true;
+    co_return false;
+}
+
+Task viaIf() {
+    bodyRan = true;
+    if (co_await inner()) co_return true;
+    co_return false;
+}
+
+static bool check(const char *name, Task t) {
+    bodyRan = false;
+    t.handle.resume();
+    const bool ok = bodyRan && t.handle.done() && t.handle.promise().value;
+    std::printf("%s: %s\n", name, ok ? "ok" : "body skipped");
+    return ok;
+}
+
+int main() {
+    const bool decl = check("decl", viaDecl());
+    const bool cond = check("if", viaIf());
+    return decl && cond ? 0 : 1;
+}
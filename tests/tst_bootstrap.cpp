@@ -0,0 +1,97 @@
+/**
+ * @file tst_bootstrap.cpp
+ * @brief Тесты оценки калибровочной прямой и её бутстреп-интервалов (@ref Bootstrap.h).
+ */
+
+#include <QTest>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "Bootstrap.h"
+#include "Coroutine.h"
+
+namespace {
+    using Groups = QVector<QVector<Bootstrap::Sample>>;
+
+    /// PWM = 3000 - 50 * flow; внутри уставки разброс ±2, ±4, ... с нулевым средним.
+    Groups knownLine(int perGroup) {
+        Groups groups;
+        for (double flow: {2.0, 10.0, 18.0}) {
+            QVector<Bootstrap::Sample> g;
+            for (int k = 0; k < perGroup; ++k)
+                g.append({flow, 3000 - 50 * flow + (k % 2 ? 1 : -1) * (k / 2 + 1) * 2.0});
+            groups.append(g);
+        }
+        return groups;
+    }
+
+    Coro::Task<> fitInPool(Groups groups, Bootstrap::LineFit *out) {
+        *out = co_await Coro::resultOf(QtConcurrent::run([groups] { return Bootstrap::fitLine(groups, 1000); }));
+    }
+}
+
+class TestBootstrap : public QObject {
+    Q_OBJECT
+
+private slots:
+    void estimatesKnownLine() {
+        const Bootstrap::LineFit fit = Bootstrap::fitLine(knownLine(6), 2000);
+        QVERIFY(fit.estimate.valid());
+        QCOMPARE(fit.estimate.slope, 50.0);
+        QCOMPARE(fit.estimate.offset, 2200.0);
+        QVERIFY(fit.estimate.rms > 0);
+    }
+
+    void intervalsCoverEstimate() {
+        const Bootstrap::LineFit fit = Bootstrap::fitLine(knownLine(6), 2000);
+        QVERIFY(fit.ok);
+        QCOMPARE(fit.resamples, 2000);
+        QVERIFY(fit.slope.low < fit.estimate.slope && fit.estimate.slope < fit.slope.high);
+        QVERIFY(fit.offset.low < fit.estimate.offset && fit.estimate.offset < fit.offset.high);
+        // разброс ±2..±6 PWM на размахе 16 л/мин: наклон известен с точностью около процента
+        QVERIFY(fit.slope.width() < 2.0);
+    }
+
+    void sameSeedSameIntervals() {
+        const Bootstrap::LineFit a = Bootstrap::fitLine(knownLine(6), 1000, 0.95, 7);
+        const Bootstrap::LineFit b = Bootstrap::fitLine(knownLine(6), 1000, 0.95, 7);
+        QCOMPARE(a.slope.low, b.slope.low);
+        QCOMPARE(a.slope.high, b.slope.high);
+        QCOMPARE(a.offset.low, b.offset.low);
+        QCOMPARE(a.offset.high, b.offset.high);
+    }
+
+    void smallGroupGivesNoIntervals() {
+        Groups groups = knownLine(6);
+        groups[1].resize(Bootstrap::MIN_GROUP_SAMPLES - 1);
+        const Bootstrap::LineFit fit = Bootstrap::fitLine(groups, 1000);
+        QVERIFY(!fit.ok);
+        QVERIFY(fit.estimate.valid());
+
+        groups[1].resize(1);
+        QVERIFY(!Bootstrap::fitLine(groups, 1000).ok);
+    }
+
+    void degenerateDataHasNoLine() {
+        QVERIFY(!Bootstrap::fitLine(Groups{knownLine(6).first()}, 1000).estimate.valid());
+
+        Groups flat = knownLine(6);
+        for (QVector<Bootstrap::Sample> &g: flat)
+            for (Bootstrap::Sample &s: g)
+                s.pwm = 2700;
+        const Bootstrap::LineFit fit = Bootstrap::fitLine(flat, 1000);
+        QVERIFY(!fit.estimate.valid());
+        QVERIFY(!fit.ok);
+    }
+
+    void runsInThreadPool() {
+        Bootstrap::LineFit fit;
+        Coro::Task<> task = fitInPool(knownLine(6), &fit);
+        task.start();
+        QTRY_VERIFY(!task.isRunning());
+        QVERIFY(fit.ok);
+        QCOMPARE(fit.slope.low, Bootstrap::fitLine(knownLine(6), 1000).slope.low);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBootstrap)
+#include "tst_bootstrap.moc"
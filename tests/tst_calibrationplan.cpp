@@ -0,0 +1,132 @@
+/**
+ * @file tst_calibrationplan.cpp
+ * @brief Тесты загрузки профиля калибровки и аппроксимации по точкам.
+ */
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "CalibrationPlan.h"
+#include "Insufflator.h"
+
+namespace {
+    /// Профиль из двух уставок; @p second подставляется второй уставкой как есть.
+    QByteArray profile(const QByteArray &second) {
+        return R"({ "name": "test", "setpoints": [ { "flow": 2.0 }, )" + second + " ] }";
+    }
+}
+
+class TestCalibrationPlan : public QObject {
+    Q_OBJECT
+
+private:
+    /// Записывает @p json во временный файл и загружает его.
+    bool load(const QByteArray &json, CalibrationPlan *plan, QString *error) {
+        const QString path = m_dir.filePath(QStringLiteral("profile.json"));
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        file.write(json);
+        file.close();
+        return CalibrationPlan::load(path, plan, error);
+    }
+
+    QTemporaryDir m_dir;
+
+private slots:
+    void loadsValidProfile() {
+        CalibrationPlan plan;
+        QString error;
+        QVERIFY2(load(profile(R"({ "flow": 20.0, "tolerance": 0.5, "settlePulses": 3, "timeoutMs": 1000 })"),
+                      &plan, &error), qPrintable(error));
+        QCOMPARE(plan.name, QStringLiteral("test"));
+        QCOMPARE(plan.setpoints.size(), 2);
+        QCOMPARE(plan.setpoints[0].tolerance, Units::Flow::fromRaw(30));
+        QCOMPARE(plan.setpoints[1].flow, Units::Flow::fromUnits(20));
+        QCOMPARE(plan.setpoints[1].tolerance, Units::Flow::fromRaw(50));
+        QCOMPARE(plan.setpoints[1].settlePulses, 3);
+        QCOMPARE(plan.setpoints[1].timeoutMs, 1000);
+    }
+
+    void rejectsInvalidProfile_data() {
+        QTest::addColumn<QByteArray>("json");
+
+        QTest::newRow("zero flow") << profile(R"({ "flow": 0 })");
+        QTest::newRow("negative flow") << profile(R"({ "flow": -5 })");
+        QTest::newRow("flow not a number") << profile(R"({ "flow": "20" })");
+        QTest::newRow("missing flow") << profile(R"({ "tolerance": 0.3 })");
+        QTest::newRow("zero tolerance") << profile(R"({ "flow": 20, "tolerance": 0 })");
+        QTest::newRow("zero timeout") << profile(R"({ "flow": 20, "timeoutMs": 0 })");
+        QTest::newRow("no settle pulses") << profile(R"({ "flow": 20, "settlePulses": 0 })");
+        QTest::newRow("duplicate flow") << profile(R"({ "flow": 2.001 })");
+        QTest::newRow("single setpoint") << QByteArray(R"({ "setpoints": [ { "flow": 2.0 } ] })");
+        QTest::newRow("not an object") << QByteArray("[]");
+        QTest::newRow("two-point fit tolerance")
+            << QByteArray(R"({ "fitTolerance": 0.1, "minPoints": 2, "setpoints": [ { "flow": 2 }, { "flow": 10 }, { "flow": 20 } ] })");
+    }
+
+    void rejectsInvalidProfile() {
+        QFETCH(QByteArray, json);
+        CalibrationPlan plan = CalibrationPlan::defaultPlan();
+        QString error;
+        QVERIFY(!load(json, &plan, &error));
+        QVERIFY(!error.isEmpty());
+        // при ошибке план не меняется
+        QCOMPARE(plan.name, QStringLiteral("default"));
+    }
+
+    void fitToleranceNeedsThreePoints() {
+        CalibrationPlan plan;
+        QString error;
+        QVERIFY2(load(R"({ "fitTolerance": 0.1, "setpoints": [ { "flow": 2 }, { "flow": 10 }, { "flow": 20 }, { "flow": 30 } ] })",
+                      &plan, &error), qPrintable(error));
+        QCOMPARE(plan.minPoints, CalibrationPlan::MIN_FIT_POINTS);
+
+        // без fitTolerance досрочного завершения нет, хватает двух точек
+        QVERIFY2(load(profile(R"({ "flow": 20 })"), &plan, &error), qPrintable(error));
+        QCOMPARE(plan.minPoints, 2);
+
+        // уставки идут в порядке профиля
+        QVERIFY2(load(R"({ "setpoints": [ { "flow": 20 }, { "flow": 2 }, { "flow": 10 } ] })", &plan, &error),
+                 qPrintable(error));
+        QCOMPARE(plan.setpoints[0].flow, Units::Flow::fromUnits(20));
+        QCOMPARE(plan.setpoints[1].flow, Units::Flow::fromUnits(2));
+    }
+
+    void approximatesLine() {
+        // PWM = 3000 - 50 * flow
+        const QVector<Insufflator::Point> points = {
+            {2900, Units::Flow::fromUnits(2)}, {2500, Units::Flow::fromUnits(10)}, {2100, Units::Flow::fromUnits(18)}};
+        double rms = -1;
+        const Insufflator::result res = Insufflator::approximate(points, &rms);
+        QVERIFY(res.ok);
+        QCOMPARE(res.slope, 50.0);
+        QCOMPARE(res.offset, 2200);
+        QVERIFY(rms < 1e-9);
+        QCOMPARE(Insufflator::predictPwm(points, Units::Flow::fromUnits(5)), 2750);
+    }
+
+    void rejectsDegeneratePoints() {
+        double rms = 0;
+        const QVector<Insufflator::Point> sameFlow = {
+            {2900, Units::Flow::fromUnits(10)}, {2500, Units::Flow::fromUnits(10)}};
+        QVERIFY(!Insufflator::approximate(sameFlow, &rms).ok);
+        QVERIFY(std::isinf(rms));
+
+        const QVector<Insufflator::Point> samePwm = {
+            {2700, Units::Flow::fromUnits(2)}, {2700, Units::Flow::fromUnits(20)}};
+        QVERIFY(!Insufflator::approximate(samePwm, &rms).ok);
+        QCOMPARE(Insufflator::predictPwm(samePwm, Units::Flow::fromUnits(5)), -1);
+
+        QVERIFY(!Insufflator::approximate(QVector<Insufflator::Point>{}).ok);
+
+        Insufflator::INValue two;
+        two.PWM1 = 2900;
+        two.PWM2 = 2000;
+        two.FLOW1 = two.FLOW2 = 10.0;
+        QVERIFY(!Insufflator::approximate(two).ok);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestCalibrationPlan)
+#include "tst_calibrationplan.moc"
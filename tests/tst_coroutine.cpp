@@ -0,0 +1,143 @@
+/**
+ * @file tst_coroutine.cpp
+ * @brief Тесты сопрограмм поверх цикла событий Qt (@ref Coroutine.h).
+ */
+
+#include <QElapsedTimer>
+#include <QTest>
+
+#include "Coroutine.h"
+
+namespace {
+    Coro::Task<int> answer() {
+        co_return 42;
+    }
+
+    Coro::Task<> addAnswer(int *out) {
+        const int value = co_await answer();
+        *out += value;
+    }
+
+    Coro::Task<> sleepThenSet(int ms, bool *done) {
+        co_await Coro::sleep(ms);
+        *done = true;
+    }
+
+    Coro::Task<> lockInTurn(Coro::Mutex *mutex, int id, QVector<int> *order) {
+        const Coro::Mutex::Lock lock = co_await mutex->lock();
+        order->append(id);
+        co_await Coro::sleep(10);
+    }
+
+    Coro::Task<> busyThenTick(Coro::Ticker *ticker, int busyMs, qint64 *waitedMs) {
+        co_await Coro::sleep(busyMs);
+        QElapsedTimer waited;
+        waited.start();
+        co_await ticker->next();
+        *waitedMs = waited.elapsed();
+    }
+}
+
+class TestCoroutine : public QObject {
+    Q_OBJECT
+
+private slots:
+    void taskReturnsValue() {
+        int sum = 0;
+        Coro::Task<> task = addAnswer(&sum);
+        QVERIFY(!task.isRunning());
+        task.start();
+        QCOMPARE(sum, 42);
+        QVERIFY(!task.isRunning());
+    }
+
+    void reassignedTaskStarts() {
+        int sum = 0;
+        Coro::Task<> task = addAnswer(&sum);
+        task.start();
+        task = addAnswer(&sum);
+        task.start();
+        QCOMPARE(sum, 84);
+    }
+
+    void sleepResumesFromEventLoop() {
+        bool done = false;
+        QElapsedTimer clock;
+        clock.start();
+        Coro::Task<> task = sleepThenSet(30, &done);
+        task.start();
+        QVERIFY(!done);
+        QTRY_VERIFY(done);
+        QVERIFY(clock.elapsed() >= 30);
+    }
+
+    void destroyedTaskIsNotResumed() {
+        bool done = false;
+        {
+            Coro::Task<> task = sleepThenSet(10, &done);
+            task.start();
+        }
+        QTest::qWait(50);
+        QVERIFY(!done);
+    }
+
+    void mutexServesWaitersInOrder() {
+        Coro::Mutex mutex;
+        QVector<int> order;
+        Coro::Task<> a = lockInTurn(&mutex, 1, &order);
+        Coro::Task<> b = lockInTurn(&mutex, 2, &order);
+        Coro::Task<> c = lockInTurn(&mutex, 3, &order);
+        a.start();
+        b.start();
+        c.start();
+        QCOMPARE(order, QVector<int>({1}));
+        QTRY_VERIFY(!a.isRunning() && !b.isRunning() && !c.isRunning());
+        QCOMPARE(order, QVector<int>({1, 2, 3}));
+        QVERIFY(!mutex.isLocked());
+    }
+
+    void unlockResumesFromEventLoop() {
+        Coro::Mutex mutex;
+        QVector<int> order;
+        {
+            Coro::Task<> a = lockInTurn(&mutex, 1, &order);
+            Coro::Task<> b = lockInTurn(&mutex, 2, &order);
+            a.start();
+            b.start();
+            // отмена владельца не продолжает следующего внутри разрушения
+            a = {};
+            QCOMPARE(order, QVector<int>({1}));
+            QVERIFY(mutex.isLocked());
+            QTRY_COMPARE(order, QVector<int>({1, 2}));
+        }
+        // b отменён вместе с блокировкой: очередь пуста, мьютекс свободен
+        QTRY_VERIFY(!mutex.isLocked());
+    }
+
+    void cancelledWaiterLeavesQueue() {
+        Coro::Mutex mutex;
+        QVector<int> order;
+        Coro::Task<> a = lockInTurn(&mutex, 1, &order);
+        a.start();
+        {
+            Coro::Task<> b = lockInTurn(&mutex, 2, &order);
+            b.start();
+        }
+        QTRY_VERIFY(!a.isRunning());
+        QCOMPARE(order, QVector<int>({1}));
+        QVERIFY(!mutex.isLocked());
+    }
+
+    void tickerKeepsOneMissedTick() {
+        Coro::Ticker ticker(20);
+        qint64 waitedMs = -1;
+        Coro::Task<> task = busyThenTick(&ticker, 50, &waitedMs);
+        task.start();
+        QTRY_VERIFY(!task.isRunning());
+        // тики пришли, пока сопрограмма была занята: следующий не ждётся
+        QVERIFY(waitedMs >= 0 && waitedMs < 20);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestCoroutine)
+#include "tst_coroutine.moc"
@@ -0,0 +1,64 @@
+/**
+ * @file tst_metricsserver.cpp
+ * @brief Тесты разбора запроса и ответа HTTP-сервера метрик (@ref MetricsServer.h).
+ */
+
+#include <QTcpSocket>
+#include <QTest>
+
+#include "MetricsServer.h"
+
+namespace {
+    /// Отправляет @p request серверу на loopback и возвращает ответ целиком.
+    QByteArray fetch(quint16 port, const QByteArray &request) {
+        QTcpSocket client;
+        QByteArray response;
+        QObject::connect(&client, &QTcpSocket::readyRead, &client, [&] { response += client.readAll(); });
+        client.connectToHost(QHostAddress::LocalHost, port);
+        client.write(request);
+        QTest::qWaitFor([&] { return client.state() == QAbstractSocket::UnconnectedState; }, 5000);
+        response += client.readAll();
+        return response;
+    }
+}
+
+class TestMetricsServer : public QObject {
+    Q_OBJECT
+
+private slots:
+    void requestLine_data() {
+        QTest::addColumn<QByteArray>("line");
+        QTest::addColumn<bool>("metrics");
+
+        QTest::newRow("plain") << QByteArray("GET /metrics HTTP/1.1") << true;
+        QTest::newRow("http/1.0") << QByteArray("GET /metrics HTTP/1.0") << true;
+        QTest::newRow("no version") << QByteArray("GET /metrics") << true;
+        QTest::newRow("query") << QByteArray("GET /metrics?name[]=valve_tuner_flow HTTP/1.1") << true;
+        QTest::newRow("fragment") << QByteArray("GET /metrics#top HTTP/1.1") << true;
+        QTest::newRow("other path") << QByteArray("GET /metricsx HTTP/1.1") << false;
+        QTest::newRow("root") << QByteArray("GET / HTTP/1.1") << false;
+        QTest::newRow("post") << QByteArray("POST /metrics HTTP/1.1") << false;
+        QTest::newRow("empty") << QByteArray() << false;
+    }
+
+    void requestLine() {
+        QFETCH(QByteArray, line);
+        QFETCH(bool, metrics);
+        QCOMPARE(MetricsServer::isMetricsRequest(line), metrics);
+    }
+
+    void servesMetricsOverLoopback() {
+        MetricsServer server;
+        QVERIFY(server.listen(0));
+
+        const QByteArray ok = fetch(server.serverPort(), "GET /metrics?x=1 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        QVERIFY(ok.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(ok.contains("valve_tuner_"));
+
+        const QByteArray missing = fetch(server.serverPort(), "GET /other HTTP/1.1\r\n\r\n");
+        QVERIFY(missing.startsWith("HTTP/1.1 404 Not Found\r\n"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestMetricsServer)
+#include "tst_metricsserver.moc"
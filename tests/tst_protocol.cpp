@@ -0,0 +1,147 @@
+/**
+ * @file tst_protocol.cpp
+ * @brief Тесты величин с фиксированной точкой, декодирования команд и кадров протокола.
+ */
+
+#include <QTest>
+
+#include "SendAndReadData.h"
+
+class TestProtocol : public QObject {
+    Q_OBJECT
+
+private slots:
+    void fixedArithmeticIsExact() {
+        const Units::Flow a = Units::Flow::fromDouble(9.95);
+        const Units::Flow b = Units::Flow::fromRaw(10);
+        QCOMPARE(a.raw(), 995);
+        QCOMPARE((a + b).raw(), 1005);
+        QCOMPARE((a - b).raw(), 985);
+        QCOMPARE((b - a).abs().raw(), 985);
+        QCOMPARE((b * 3).raw(), 30);
+        QVERIFY(b < a);
+        QCOMPARE(Units::Flow::fromUnits(10).toDouble(), 10.0);
+    }
+
+    void fixedRescaleRoundsToNearest() {
+        QCOMPARE(Units::Flow::fromRaw(995).rescale<10>().raw(), 100);
+        QCOMPARE(Units::Flow::fromRaw(994).rescale<10>().raw(), 99);
+        QCOMPARE(Units::Flow::fromRaw(-995).rescale<10>().raw(), -100);
+        QCOMPARE(Units::FlowTenths::fromRaw(7).rescale<100>().raw(), 70);
+    }
+
+    void decodeAppliesWireScale() {
+        QCOMPARE(Protocol::GetMsrFlow::decode(950), Units::Flow::fromRaw(950));
+        QCOMPARE(Protocol::GetMedFlow::decode(95).toDouble(), 9.5);
+        QCOMPARE(Protocol::GetTemperature::decode(75).toDouble(), 37.5);
+        QCOMPARE(Protocol::GetMsrPres::decode(150).toDouble(), 15.0);
+    }
+
+    void pressureIsSignExtended() {
+        // -3.0 мм рт. ст. передаётся как 0xFFE2
+        QCOMPARE(Protocol::GetMsrPres::decode(0xFFE2).raw(), -30);
+        QCOMPARE(Protocol::GetRdcPres::decode(0xFFFF).raw(), -1);
+        QCOMPARE(Protocol::GetMedPres::decode(0x8000).raw(), -32768);
+        QVERIFY(Protocol::GetMsrPres::descriptor.signedRaw);
+
+        // расход и температура без знака
+        QCOMPARE(Protocol::GetMsrFlow::decode(0xFFE2).raw(), 0xFFE2);
+        QVERIFY(!Protocol::GetTemperature::descriptor.signedRaw);
+    }
+
+    void encodeFitsDataField() {
+        QCOMPARE(Protocol::GetMsrFlow::encode(true), uint16_t(1));
+        QCOMPARE(Protocol::SetShim::encode(2699), uint16_t(2699));
+        QCOMPARE(Protocol::KeySig::encode(INSUF::KEY_SERVICE_SIG), uint16_t(INSUF::KEY_SERVICE_SIG));
+    }
+
+    void frameRoundTrip_data() {
+        QTest::addColumn<int>("address");
+        QTest::addColumn<int>("tag");
+        QTest::addColumn<int>("value");
+
+        QTest::newRow("plain") << int(REGUL::ADDRESS) << int(REGUL::GET_MSR_FLOW) << 950;
+        QTest::newRow("fend in data") << int(REDUC::ADDRESS) << int(REDUC::SET_SHIM) << 0xC0C0;
+        QTest::newRow("fesc in data") << int(REDUC::ADDRESS) << int(REDUC::SET_SHIM) << 0x00DB;
+        QTest::newRow("bare tfend in data") << int(REDUC::ADDRESS) << int(REDUC::SET_SHIM) << 0xDDDC;
+        QTest::newRow("flow 1.92") << int(REGUL::ADDRESS) << int(REGUL::GET_MSR_FLOW) << 192;
+        QTest::newRow("negative pressure") << int(REGUL::ADDRESS) << int(REGUL::GET_MSR_PRES) << 0xFFE2;
+    }
+
+    void frameRoundTrip() {
+        QFETCH(int, address);
+        QFETCH(int, tag);
+        QFETCH(int, value);
+
+        const QByteArray frame = Data::encodeFrame(address, tag, value & 0xFF, value >> 8, 0xC0);
+        QCOMPARE(static_cast<unsigned char>(frame[0]), static_cast<unsigned char>(0xC0));
+        QCOMPARE(frame.indexOf(static_cast<char>(0xC0), 1), -1);
+
+        Data::DataNode node;
+        QVERIFY(Data::decodeFrame(frame, &node));
+        QCOMPARE(int(node.address), address);
+        QCOMPARE(int(static_cast<unsigned char>(node.tag)), tag);
+        QCOMPARE(int(node.data), value);
+
+        // кадр, пришедший по частям, выделяется целиком и только когда дошёл
+        QByteArray buffer = QByteArray("\x01\x02") + frame.left(frame.size() - 1);
+        QVERIFY(UART::takeFrame(&buffer).isEmpty());
+        buffer += frame.right(1) + frame.left(2);
+        QCOMPARE(UART::takeFrame(&buffer), frame);
+        QCOMPARE(buffer, frame.left(2));
+    }
+
+    void decodeRejectsCorruptFrames_data() {
+        QTest::addColumn<QByteArray>("frame");
+
+        const QByteArray good = Data::encodeFrame(REGUL::ADDRESS, REGUL::GET_MSR_FLOW, 0xC0, 0x00, 0xC0);
+        QByteArray badCrc = good;
+        badCrc[badCrc.size() - 1] = static_cast<char>(badCrc[badCrc.size() - 1] ^ 0x01);
+        // экранирование, применённое дважды: после снятия одного слоя кадр длиннее PACKET_SIZE
+        QByteArray doubleStuffed = good.left(1);
+        for (int i = 1; i < good.size(); ++i)
+            doubleStuffed += static_cast<unsigned char>(good[i]) == 0xDB ? QByteArray("\xDB\xDD") : good.mid(i, 1);
+
+        QTest::newRow("crc mismatch") << badCrc;
+        QTest::newRow("short") << good.left(good.size() - 1);
+        QTest::newRow("double stuffed") << doubleStuffed;
+        QTest::newRow("unknown escape") << QByteArray("\xC0\x02\xDB\x01\x00\x00\x00", 7);
+        QTest::newRow("fend inside") << QByteArray("\xC0\x02\xC0\x00\x00\x00", 6);
+        QTest::newRow("no fend") << good.mid(1);
+    }
+
+    void decodeRejectsCorruptFrames() {
+        QFETCH(QByteArray, frame);
+
+        Data::DataNode node{0x55, 0x55, 0x5555};
+        QVERIFY(!Data::decodeFrame(frame, &node));
+        QCOMPARE(int(node.address), 0x55);
+        QCOMPARE(int(node.data), 0x5555);
+    }
+
+    void takeFrameResynchronises() {
+        const QByteArray good = Data::encodeFrame(REDUC::ADDRESS, REDUC::SET_SHIM, 0xDB, 0xC0, 0xC0);
+
+        // оборванный кадр: следующий FEND начинает новый
+        QByteArray buffer = QByteArray("\xC0\x02\x03", 3) + good;
+        QCOMPARE(UART::takeFrame(&buffer), good);
+        QVERIFY(buffer.isEmpty());
+
+        // неизвестная пара FESC отбрасывает начатый кадр
+        buffer = QByteArray("\xC0\x02\xDB\x01", 4) + good;
+        QCOMPARE(UART::takeFrame(&buffer), good);
+
+        // FESC последним байтом буфера: ждём его пару
+        buffer = good.left(good.indexOf(static_cast<char>(0xDB)) + 1);
+        QVERIFY(UART::takeFrame(&buffer).isEmpty());
+        QCOMPARE(buffer.size(), good.indexOf(static_cast<char>(0xDB)) + 1);
+
+        // байты без FEND отбрасываются
+        buffer = QByteArray("\x01\xDB\x02", 3);
+        QVERIFY(UART::takeFrame(&buffer).isEmpty());
+        QVERIFY(buffer.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestProtocol)
+#include "tst_protocol.moc"
@@ -0,0 +1,126 @@
+/**
+ * @file tst_samplearchive.cpp
+ * @brief Тесты записи и чтения архива измерений (@ref SampleArchive.h).
+ */
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "SampleArchive.h"
+
+namespace {
+    /// Измерения с неровным периодом и разнознаковыми приращениями.
+    QVector<SampleArchive::Record> samples(int n) {
+        QVector<SampleArchive::Record> out;
+        SampleArchive::Record r{1700000000000, 0, 2700};
+        for (int i = 0; i < n; ++i) {
+            r.timestampMs += 50 + (i * 7) % 5 - 2;
+            r.flow += (i * 37) % 201 - 100;
+            r.pwm += (i * 13) % 21 - 10;
+            out.append(r);
+        }
+        return out;
+    }
+
+    void write(const QString &path, const QVector<SampleArchive::Record> &records) {
+        SampleArchiveWriter writer(path);
+        for (const SampleArchive::Record &r: records)
+            writer.append(r);
+    }
+
+    bool same(const SampleArchive::Record &a, const SampleArchive::Record &b) {
+        return a.timestampMs == b.timestampMs && a.flow == b.flow && a.pwm == b.pwm;
+    }
+}
+
+class TestSampleArchive : public QObject {
+    Q_OBJECT
+
+private:
+    QString path() const { return m_dir.filePath(QStringLiteral("session.vta")); }
+
+    QTemporaryDir m_dir;
+
+private slots:
+    void roundTrip() {
+        const QVector<SampleArchive::Record> records = samples(SampleArchive::BLOCK_SAMPLES * 2 + 37);
+        write(path(), records);
+
+        SampleArchiveReader reader(path());
+        QVERIFY(reader.isValid());
+        QVERIFY(!reader.isTruncated());
+        QCOMPARE(reader.index().size(), 3);
+        QCOMPARE(reader.index()[2].count, 37u);
+        QCOMPARE(reader.sampleCount(), records.size());
+
+        QVector<SampleArchive::Record> read;
+        QVERIFY(reader.forEach([&](const SampleArchive::Record &r) { read.append(r); }));
+        QCOMPARE(read.size(), records.size());
+        for (int i = 0; i < read.size(); ++i)
+            QVERIFY2(same(read[i], records[i]), qPrintable(QString::number(i)));
+    }
+
+    void fullBlocksReachDiskBeforeClose() {
+        const QVector<SampleArchive::Record> records = samples(SampleArchive::BLOCK_SAMPLES + 5);
+        SampleArchiveWriter writer(path());
+        for (const SampleArchive::Record &r: records)
+            writer.append(r);
+
+        // писатель ещё открыт: читается первый блок, неполный второй в памяти
+        SampleArchiveReader reader(path());
+        QVERIFY(reader.isValid());
+        QCOMPARE(reader.index().size(), 1);
+        QCOMPARE(reader.sampleCount(), qint64(SampleArchive::BLOCK_SAMPLES));
+    }
+
+    void truncatedTailIsDropped() {
+        write(path(), samples(SampleArchive::BLOCK_SAMPLES * 2 + 37));
+        QFile file(path());
+        QVERIFY(file.resize(file.size() - 3));
+
+        SampleArchiveReader reader(path());
+        QVERIFY(reader.isValid());
+        QVERIFY(reader.isTruncated());
+        QCOMPARE(reader.index().size(), 2);
+        qint64 read = 0;
+        QVERIFY(reader.forEach([&](const SampleArchive::Record &) { ++read; }));
+        QCOMPARE(read, qint64(SampleArchive::BLOCK_SAMPLES * 2));
+    }
+
+    void corruptCountIsRejected_data() {
+        QTest::addColumn<quint32>("count");
+
+        QTest::newRow("zero") << quint32(0);
+        QTest::newRow("above block size") << quint32(SampleArchive::BLOCK_SAMPLES + 1);
+        QTest::newRow("huge") << quint32(0x7FFFFFFF);
+    }
+
+    void corruptCountIsRejected() {
+        QFETCH(quint32, count);
+        write(path(), samples(SampleArchive::BLOCK_SAMPLES));
+
+        QFile file(path());
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.seek(SampleArchive::FILE_HEADER_SIZE + 4));
+        QByteArray field;
+        SampleArchive::putLE<uint32_t>(field, count);
+        file.write(field);
+        file.close();
+
+        SampleArchiveReader reader(path());
+        QVERIFY(reader.isValid());
+        QVERIFY(reader.isTruncated());
+        QVERIFY(reader.index().isEmpty());
+    }
+
+    void emptyArchive() {
+        write(path(), {});
+        SampleArchiveReader reader(path());
+        QVERIFY(reader.isValid());
+        QVERIFY(!reader.isTruncated());
+        QCOMPARE(reader.sampleCount(), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSampleArchive)
+#include "tst_samplearchive.moc"
@@ -49,7 +49,7 @@ endif()
 # ----------------------------------------------------------------------------
 # Общие флаги (по желанию можно расширять)
 # ----------------------------------------------------------------------------
-set(CMAKE_CXX_STANDARD 17)
+set(CMAKE_CXX_STANDARD 20)
 set(CMAKE_CXX_STANDARD_REQUIRED ON)
 
 
@@ -0,0 +1,884 @@
+/**
+ * @file LogAnalyzer.cpp
+ * @brief Офлайн-анализ журналов @c debug.log и архивов сессий (*.vta) станций настройки.
+ *
+ * Все входные файлы отображаются в память, журналы режутся на куски по
+ * границам строк, и куски разбираются параллельно на всех ядрах
+ * (QtConcurrent). Из событий каждого файла восстанавливаются сессии
+ * калибровки и их уставки (фазы): команды, RTT, траектория расхода,
+ * время установления. Результат — строка CSV на каждую фазу и сводка
+ * JSON с распределениями и выбросами.
+ *
+ * Пример:
+ * @code
+ * valve-log-analyzer --csv phases.csv --json summary.json --timelines tl/ logs/
+ * @endcode
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QTimeZone>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "orders.h"
+#include "Protocol.h"
+#include "SampleArchive.h"
+
+namespace {
+    constexpr qint64 CHUNK_BYTES = 8 << 20;   ///< Размер куска журнала для одного потока.
+    constexpr int64_t ARCHIVE_GAP_MS = 1500;  ///< Пауза в архиве, разделяющая уставки.
+
+    /// Вид события журнала.
+    enum class EventKind : uint8_t {
+        Write,       ///< Отправлен кадр (address, command, value = данные).
+        Read,        ///< Приняты байты.
+        Value,       ///< Значение канала опроса (command = Channel, value — сырое).
+        Alarm,       ///< Тревога (value = номер сигнала).
+        PhaseStart,  ///< Начало уставки (только для архивов).
+        Pwm,         ///< Новый PWM клапана (только для архивов).
+    };
+
+    /// Каналы опроса, которые пишет @c PollScheduler.
+    enum Channel : uint8_t { FLOW, PRES, RDC_PRES, TEMP };
+
+    /// Масштаб и знак значения канала — как у команды протокола, которой он опрашивается.
+    struct ChannelWire {
+        int scale;       ///< Отсчётов в единице величины.
+        bool signedRaw;  ///< Значение со знаком (16-битный дополнительный код).
+    };
+
+    constexpr ChannelWire channelWire[] = {
+        {Protocol::GetMsrFlow::Reply::scale, Protocol::GetMsrFlow::signedRaw},
+        {Protocol::GetMsrPres::Reply::scale, Protocol::GetMsrPres::signedRaw},
+        {Protocol::GetRdcPres::Reply::scale, Protocol::GetRdcPres::signedRaw},
+        {Protocol::GetTemperature::Reply::scale, Protocol::GetTemperature::signedRaw},
+    };
+
+    /// Значение канала в единицах величины (л/мин, мм рт. ст., °C) по отсчётам из журнала.
+    inline double channelValue(uint8_t channel, double raw) {
+        const ChannelWire &wire = channelWire[channel];
+        // старые журналы писали давление беззнаковым словом: 65506 — это -30
+        if (wire.signedRaw && raw >= 32768)
+            raw -= 65536;
+        return raw / wire.scale;
+    }
+
+    /// Флаг события: метка времени с миллисекундами.
+    constexpr uint8_t PRECISE = 1;
+
+    /// Одно событие, извлечённое из строки журнала или записи архива.
+    struct Event {
+        int64_t timeMs;   ///< Время, мс (локальное время станции как «наивный» UTC).
+        double value;
+        EventKind kind;
+        uint8_t address;
+        uint8_t command;
+        uint8_t flags;
+    };
+
+    /// Кусок отображённого журнала, разбираемый одним потоком.
+    struct Chunk {
+        int file;
+        const char *begin;
+        const char *end;
+        std::vector<Event> events;
+        qint64 lines = 0;
+    };
+
+    /// Одна уставка внутри сессии.
+    struct Phase {
+        int session = 0;
+        int index = 0;
+        int64_t startMs = 0;
+        int64_t endMs = 0;
+        bool complete = false;     ///< Уставка закрыта штатно (SHUT_OFF + OFF_FLOW / конец архива).
+        int commands = 0;
+        int unanswered = 0;        ///< Запросы, за которыми не последовало ни одного ответа.
+        int pulses = 0;
+        int alarms = 0;
+        int pwm = -1;              ///< Последний установленный PWM.
+        QVector<double> rttMs;
+        QVector<double> flow;      ///< Траектория расхода, л/мин.
+        QVector<int64_t> flowAt;   ///< Время точек траектории.
+        size_t firstEvent = 0;     ///< Диапазон событий фазы в журнале файла.
+        size_t lastEvent = 0;
+
+        double flowFinal = NAN;
+        double flowMin = NAN;
+        double flowMax = NAN;
+        double settleS = NAN;      ///< От начала уставки до входа расхода в допуск навсегда.
+    };
+
+    /// Результат анализа одного файла.
+    struct FileResult {
+        QString path;
+        bool archive = false;
+        bool ok = true;
+        qint64 bytes = 0;
+        qint64 lines = 0;
+        std::vector<Event> events;
+        QVector<Phase> phases;
+    };
+
+    // --------------------------------------------------------------------
+    // Разбор строк
+    // --------------------------------------------------------------------
+
+    inline int digits(const char *p, int n) {
+        int v = 0;
+        for (int i = 0; i < n; ++i) {
+            const unsigned d = static_cast<unsigned char>(p[i]) - '0';
+            if (d > 9)
+                return -1;
+            v = v * 10 + static_cast<int>(d);
+        }
+        return v;
+    }
+
+    /// Дни от 1970-01-01 по григорианскому календарю.
+    inline int64_t daysFromCivil(int y, int m, int d) {
+        y -= m <= 2;
+        const int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const int64_t yoe = y - era * 400;
+        const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    /**
+     * @brief Разбирает «yyyy-MM-dd HH:mm:ss[.zzz] - » в начале строки.
+     * @return Указатель на текст сообщения или @c nullptr.
+     */
+    const char *parseTimestamp(const char *p, const char *end, int64_t *timeMs, uint8_t *flags) {
+        if (end - p < 22 || p[4] != '-' || p[7] != '-' || p[10] != ' ' || p[13] != ':' || p[16] != ':')
+            return nullptr;
+        const int y = digits(p, 4), mo = digits(p + 5, 2), d = digits(p + 8, 2);
+        const int h = digits(p + 11, 2), mi = digits(p + 14, 2), s = digits(p + 17, 2);
+        if (y < 0 || mo < 1 || d < 1 || h < 0 || mi < 0 || s < 0)
+            return nullptr;
+
+        int ms = 0;
+        const char *q = p + 19;
+        *flags = 0;
+        if (*q == '.' && end - q >= 4 + 3) {
+            ms = digits(q + 1, 3);
+            if (ms < 0)
+                return nullptr;
+            q += 4;
+            *flags = PRECISE;
+        }
+        if (end - q < 3 || q[0] != ' ' || q[1] != '-' || q[2] != ' ')
+            return nullptr;
+
+        *timeMs = ((daysFromCivil(y, mo, d) * 24 + h) * 60 + mi) * 60000LL + s * 1000LL + ms;
+        return q + 3;
+    }
+
+    inline bool startsWith(const char *p, const char *end, const char *prefix, size_t n) {
+        return size_t(end - p) >= n && std::memcmp(p, prefix, n) == 0;
+    }
+
+    inline int hexNibble(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    /**
+     * @brief Восстанавливает кадр из hex-дампа «WRITING: N byte - c0...».
+     *
+     * Снимает байт-стаффинг (DB DC → C0, DB DD → DB) и возвращает
+     * адрес, команду и 16-битное значение данных.
+     */
+    bool parseFrame(const char *p, const char *end, uint8_t *address, uint8_t *command, uint16_t *value) {
+        const char *hex = nullptr;
+        for (const char *q = p; q + 2 < end; ++q) {
+            if (q[0] == ' ' && q[1] == '-' && q[2] == ' ') {
+                hex = q + 3;
+                break;
+            }
+        }
+        if (!hex)
+            return false;
+
+        uint8_t frame[6];
+        int n = 0;
+        bool escape = false;
+        for (const char *q = hex; q + 1 < end && n < 6; q += 2) {
+            const int hi = hexNibble(q[0]), lo = hexNibble(q[1]);
+            if (hi < 0 || lo < 0)
+                break;
+            uint8_t b = static_cast<uint8_t>(hi << 4 | lo);
+            if (escape) {
+                b = b == 0xDC ? 0xC0 : b == 0xDD ? 0xDB : b;
+                escape = false;
+            } else if (b == 0xDB && n > 0) {
+                escape = true;
+                continue;
+            }
+            frame[n++] = b;
+        }
+        if (n < 5 || frame[0] != 0xC0)
+            return false;
+        *address = frame[1];
+        *command = frame[2];
+        *value = static_cast<uint16_t>(frame[3] | frame[4] << 8);
+        return true;
+    }
+
+    /// Номер сигнала тревоги по имени из строки «ALARM: NAME».
+    int alarmCode(const char *p, const char *end) {
+        for (int sig = 0; sig < 256; ++sig) {
+            if (!INSUF::isAlarm(static_cast<unsigned char>(sig)))
+                continue;
+            const char *name = INSUF::alarmName(static_cast<unsigned char>(sig));
+            const size_t n = std::strlen(name);
+            if (size_t(end - p) == n && std::memcmp(p, name, n) == 0)
+                return sig;
+        }
+        return 0;
+    }
+
+    /// Число вида «-123.45» (формат @c UART::logUARTData) без копирования строки.
+    double parseDecimal(const char *p, const char *end) {
+        const bool negative = p < end && *p == '-';
+        if (negative)
+            ++p;
+        double v = 0;
+        for (; p < end && unsigned(*p - '0') <= 9; ++p)
+            v = v * 10 + (*p - '0');
+        if (p < end && *p == '.') {
+            double scale = 0.1;
+            for (++p; p < end && unsigned(*p - '0') <= 9; ++p, scale *= 0.1)
+                v += (*p - '0') * scale;
+        }
+        return negative ? -v : v;
+    }
+
+    /// Разбирает одну строку журнала; строки других форматов пропускаются.
+    void parseLine(const char *p, const char *end, std::vector<Event> &out) {
+        if (end > p && end[-1] == '\r')
+            --end;
+
+        Event e{};
+        const char *msg = parseTimestamp(p, end, &e.timeMs, &e.flags);
+        if (!msg)
+            return;
+
+        static const struct { const char *prefix; size_t size; Channel channel; } channels[] = {
+            {"FLOW: ", 6, FLOW}, {"PRES: ", 6, PRES}, {"RDC_PRES: ", 10, RDC_PRES}, {"TEMP: ", 6, TEMP},
+        };
+
+        if (startsWith(msg, end, "WRITING: ", 9)) {
+            uint16_t value = 0;
+            if (!parseFrame(msg + 9, end, &e.address, &e.command, &value))
+                return;
+            e.kind = EventKind::Write;
+            e.value = value;
+        } else if (startsWith(msg, end, "READING: ", 9)) {
+            if (startsWith(msg + 9, end, "no data", 7))
+                return;
+            e.kind = EventKind::Read;
+        } else if (startsWith(msg, end, "ALARM: ", 7)) {
+            e.kind = EventKind::Alarm;
+            e.value = alarmCode(msg + 7, end);
+        } else {
+            bool matched = false;
+            for (const auto &c: channels) {
+                if (startsWith(msg, end, c.prefix, c.size)) {
+                    e.kind = EventKind::Value;
+                    e.command = c.channel;
+                    e.value = parseDecimal(msg + c.size, end);
+                    matched = true;
+                    break;
+                }
+            }
+            if (!matched)
+                return;
+        }
+        out.push_back(e);
+    }
+
+    void parseChunk(Chunk &chunk) {
+        chunk.events.reserve(size_t(chunk.end - chunk.begin) / 48);
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            const char *nl = static_cast<const char *>(std::memchr(p, '\n', size_t(chunk.end - p)));
+            const char *lineEnd = nl ? nl : chunk.end;
+            parseLine(p, lineEnd, chunk.events);
+            ++chunk.lines;
+            p = lineEnd + 1;
+        }
+    }
+
+    /// События архива: границы уставок по паузам, расход и смены PWM.
+    bool archiveEvents(const QString &path, std::vector<Event> *out) {
+        SampleArchiveReader reader(path);
+        if (!reader.isValid())
+            return false;
+
+        out->reserve(size_t(reader.sampleCount()) * 5 / 4);
+        int64_t last = INT64_MIN;
+        int32_t pwm = -1;
+        return reader.forEach([&](const SampleArchive::Record &r) {
+            if (last == INT64_MIN || r.timestampMs - last > ARCHIVE_GAP_MS) {
+                out->push_back(Event{r.timestampMs, 0, EventKind::PhaseStart, 0, 0, PRECISE});
+                pwm = -1;
+            }
+            if (r.pwm != pwm) {
+                out->push_back(Event{r.timestampMs, double(r.pwm), EventKind::Pwm, 0, 0, PRECISE});
+                pwm = r.pwm;
+            }
+            out->push_back(Event{r.timestampMs, double(r.flow), EventKind::Value, 0, FLOW, PRECISE});
+            last = r.timestampMs;
+        });
+    }
+
+    // --------------------------------------------------------------------
+    // Восстановление сессий
+    // --------------------------------------------------------------------
+
+    /// Характеристики траектории расхода фазы.
+    void finishPhase(Phase &ph, double tolerance) {
+        if (ph.flow.isEmpty())
+            return;
+        const int n = ph.flow.size();
+        const int tail = qMin(3, n);
+        double sum = 0;
+        for (int i = n - tail; i < n; ++i)
+            sum += ph.flow[i];
+        ph.flowFinal = sum / tail;
+        ph.flowMin = *std::min_element(ph.flow.cbegin(), ph.flow.cend());
+        ph.flowMax = *std::max_element(ph.flow.cbegin(), ph.flow.cend());
+
+        int settled = n;
+        while (settled > 0 && std::fabs(ph.flow[settled - 1] - ph.flowFinal) <= tolerance)
+            --settled;
+        if (settled < n && n >= 5)
+            ph.settleS = (ph.flowAt[settled] - ph.startMs) / 1000.0;
+    }
+
+    /**
+     * @brief Делит события файла на сессии и уставки.
+     *
+     * Уставка начинается с сервисного KEY_SIG (конструктор
+     * @c Insufflator) и заканчивается OFF_FLOW после SHUT_OFF
+     * (деструктор). Уставки, между которыми больше @p sessionGapMs,
+     * относятся к разным сессиям. Для архивов границы уставок заданы
+     * событиями @c PhaseStart, а весь файл — одна сессия.
+     */
+    void buildPhases(FileResult &file, double tolerance, int64_t sessionGapMs) {
+        const std::vector<Event> &events = file.events;
+        Phase current;
+        bool open = false;
+        bool awaitingReply = false;
+        bool shutOff = false;
+        int64_t sentAt = 0;
+        bool sentPrecise = false;
+        int session = 0;
+        int index = 0;
+        int64_t lastEnd = INT64_MIN;
+
+        auto close = [&](size_t i, int64_t endMs, bool complete) {
+            current.endMs = endMs;
+            current.lastEvent = i;
+            current.complete = complete;
+            finishPhase(current, tolerance);
+            file.phases.append(current);
+            lastEnd = endMs;
+            open = false;
+        };
+
+        auto start = [&](size_t i, int64_t t) {
+            // в архиве уставка заканчивается последним измерением перед паузой
+            if (open)
+                close(i, file.archive ? events[i - 1].timeMs : t, file.archive);
+            if (file.phases.isEmpty() || (!file.archive && t - lastEnd > sessionGapMs)) {
+                ++session;
+                index = 0;
+            }
+            current = Phase{};
+            current.session = session;
+            current.index = index++;
+            current.startMs = t;
+            current.firstEvent = i;
+            open = true;
+            awaitingReply = false;
+            shutOff = false;
+        };
+
+        for (size_t i = 0; i < events.size(); ++i) {
+            const Event &e = events[i];
+            switch (e.kind) {
+                case EventKind::PhaseStart:
+                    start(i, e.timeMs);
+                    break;
+
+                case EventKind::Write:
+                    if (e.address == KEYS::ADDRESS && e.command == KEYS::KEY_SIG &&
+                        (int(e.value) & 0xFF) == INSUF::KEY_SERVICE_SIG)
+                        start(i, e.timeMs);
+                    if (!open)
+                        break;
+                    ++current.commands;
+                    if (awaitingReply)
+                        ++current.unanswered;
+                    awaitingReply = true;
+                    sentAt = e.timeMs;
+                    sentPrecise = e.flags & PRECISE;
+                    if (e.address == REDUC::ADDRESS && e.command == REDUC::SET_SHIM) {
+                        ++current.pulses;
+                        current.pwm = int(e.value);
+                    } else if (e.address == REDUC::ADDRESS && e.command == REDUC::SHUT_OFF) {
+                        shutOff = true;
+                    } else if (e.address == REDUC::ADDRESS && e.command == REDUC::OFF_FLOW && shutOff) {
+                        // ответ на OFF_FLOW ещё входит в уставку
+                        size_t j = i + 1;
+                        while (j < events.size() && events[j].kind != EventKind::Read &&
+                               events[j].kind != EventKind::Write)
+                            ++j;
+                        if (j < events.size() && events[j].kind == EventKind::Read) {
+                            if (sentPrecise && (events[j].flags & PRECISE))
+                                current.rttMs.append(double(events[j].timeMs - sentAt));
+                            i = j;
+                        }
+                        close(i + 1, events[i].timeMs, true);
+                    }
+                    break;
+
+                case EventKind::Read:
+                    if (open && awaitingReply) {
+                        if (sentPrecise && (e.flags & PRECISE))
+                            current.rttMs.append(double(e.timeMs - sentAt));
+                        awaitingReply = false;
+                    }
+                    break;
+
+                case EventKind::Value:
+                    if (open && e.command == FLOW) {
+                        current.flow.append(channelValue(FLOW, e.value));
+                        current.flowAt.append(e.timeMs);
+                    }
+                    break;
+
+                case EventKind::Pwm:
+                    if (open) {
+                        ++current.pulses;
+                        current.pwm = int(e.value);
+                    }
+                    break;
+
+                case EventKind::Alarm:
+                    if (open)
+                        ++current.alarms;
+                    break;
+            }
+        }
+
+        if (open)
+            close(events.size(), events.empty() ? current.startMs : events.back().timeMs, file.archive);
+    }
+
+    // --------------------------------------------------------------------
+    // Статистика и вывод
+    // --------------------------------------------------------------------
+
+    /// Квантиль по отсортированной выборке (линейная интерполяция).
+    double quantile(const QVector<double> &sorted, double q) {
+        if (sorted.isEmpty())
+            return NAN;
+        const double pos = q * (sorted.size() - 1);
+        const int i = int(pos);
+        const double frac = pos - i;
+        return i + 1 < sorted.size() ? sorted[i] * (1 - frac) + sorted[i + 1] * frac : sorted[i];
+    }
+
+    /// Медиана и медианное абсолютное отклонение.
+    struct Spread {
+        double median = NAN;
+        double mad = NAN;
+    };
+
+    Spread spread(QVector<double> values) {
+        Spread s;
+        if (values.isEmpty())
+            return s;
+        std::sort(values.begin(), values.end());
+        s.median = quantile(values, 0.5);
+        for (double &v: values)
+            v = std::fabs(v - s.median);
+        std::sort(values.begin(), values.end());
+        s.mad = quantile(values, 0.5);
+        return s;
+    }
+
+    QJsonObject distribution(QVector<double> values) {
+        QJsonObject obj;
+        obj["count"] = values.size();
+        if (values.isEmpty())
+            return obj;
+        std::sort(values.begin(), values.end());
+        double sum = 0;
+        for (double v: values)
+            sum += v;
+        obj["mean"] = sum / values.size();
+        obj["min"] = values.first();
+        obj["median"] = quantile(values, 0.5);
+        obj["p95"] = quantile(values, 0.95);
+        obj["max"] = values.last();
+        return obj;
+    }
+
+    double meanOf(const QVector<double> &v) {
+        if (v.isEmpty())
+            return NAN;
+        double sum = 0;
+        for (double x: v)
+            sum += x;
+        return sum / v.size();
+    }
+
+    double p95Of(QVector<double> v) {
+        std::sort(v.begin(), v.end());
+        return quantile(v, 0.95);
+    }
+
+    QString timeText(int64_t ms) {
+        return QDateTime::fromMSecsSinceEpoch(ms, QTimeZone::UTC).toString("yyyy-MM-dd HH:mm:ss.zzz");
+    }
+
+    QString num(double v, int precision = 3) {
+        return std::isnan(v) ? QString() : QString::number(v, 'f', precision);
+    }
+
+    /// Ссылка на фазу в общем списке.
+    struct PhaseRef {
+        const FileResult *file;
+        const Phase *phase;
+    };
+
+    void writeCsv(QTextStream &out, const QVector<PhaseRef> &phases) {
+        out << "file,session,phase,start,duration_s,complete,commands,unanswered,rtt_mean_ms,rtt_p95_ms,"
+               "pulses,pwm,flow_samples,flow_final,flow_min,flow_max,settle_s,alarms\n";
+        for (const PhaseRef &ref: phases) {
+            const Phase &ph = *ref.phase;
+            QString path = ref.file->path;
+            if (path.contains(',') || path.contains('"'))
+                path = '"' + path.replace('"', "\"\"") + '"';
+            out << path << ',' << ph.session << ',' << ph.index << ',' << timeText(ph.startMs) << ','
+                << num((ph.endMs - ph.startMs) / 1000.0) << ',' << (ph.complete ? 1 : 0) << ','
+                << ph.commands << ',' << ph.unanswered << ','
+                << num(meanOf(ph.rttMs), 1) << ',' << num(p95Of(ph.rttMs), 1) << ','
+                << ph.pulses << ',' << ph.pwm << ',' << ph.flow.size() << ','
+                << num(ph.flowFinal, 2) << ',' << num(ph.flowMin, 2) << ',' << num(ph.flowMax, 2) << ','
+                << num(ph.settleS) << ',' << ph.alarms << '\n';
+        }
+    }
+
+    /// Временная шкала одной сессии: команды, ответы, расход, тревоги.
+    void writeTimeline(const QString &dir, int number, const FileResult &file, int session) {
+        // у журналов разных станций одинаковые имена, поэтому в имени есть номер файла
+        QFile out(QDir(dir).filePath(QStringLiteral("%1-%2-s%3.csv")
+                                         .arg(number, 4, 10, QLatin1Char('0'))
+                                         .arg(QFileInfo(file.path).completeBaseName()).arg(session)));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+            return;
+        QTextStream s(&out);
+        s << "time,phase,event,address,command,value\n";
+        for (const Phase &ph: file.phases) {
+            if (ph.session != session)
+                continue;
+            for (size_t i = ph.firstEvent; i < ph.lastEvent && i < file.events.size(); ++i) {
+                const Event &e = file.events[i];
+                s << timeText(e.timeMs) << ',' << ph.index << ',';
+                switch (e.kind) {
+                    case EventKind::Write:
+                        s << "write," << Qt::hex << int(e.address) << ',' << int(e.command) << Qt::dec
+                          << ',' << int(e.value);
+                        break;
+                    case EventKind::Read:
+                        s << "read,,,";
+                        break;
+                    case EventKind::Value: {
+                        static const char *names[] = {"flow", "pres", "rdc_pres", "temp"};
+                        s << names[e.command] << ",,," << num(channelValue(e.command, e.value), 2);
+                        break;
+                    }
+                    case EventKind::Alarm:
+                        s << "alarm,,," << INSUF::alarmName(static_cast<unsigned char>(e.value));
+                        break;
+                    case EventKind::PhaseStart:
+                        s << "phase,,,";
+                        break;
+                    case EventKind::Pwm:
+                        s << "pwm,,," << int(e.value);
+                        break;
+                }
+                s << '\n';
+            }
+        }
+    }
+
+    /// Находит журналы и архивы в перечисленных файлах и каталогах.
+    QStringList collectInputs(const QStringList &args) {
+        QStringList files;
+        const QStringList filters{QStringLiteral("*.log"), QStringLiteral("*.log.*"), QStringLiteral("*.vta")};
+        for (const QString &arg: args) {
+            const QFileInfo info(arg);
+            if (info.isDir()) {
+                QDirIterator it(arg, filters, QDir::Files, QDirIterator::Subdirectories);
+                while (it.hasNext())
+                    files.append(it.next());
+            } else if (info.isFile()) {
+                files.append(info.filePath());
+            }
+        }
+        files.sort();
+        files.removeDuplicates();
+        return files;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("valve-log-analyzer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Parallel offline analysis of valve tuner debug logs and session archives.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "debug.log files, *.vta archives or directories to scan.", "inputs...");
+    const QCommandLineOption csvOption("csv", "Per-phase CSV output (default: stdout).", "file");
+    const QCommandLineOption jsonOption("json", "Aggregate statistics and outliers as JSON.", "file");
+    const QCommandLineOption timelineOption("timelines", "Write one timeline CSV per session into <dir>.", "dir");
+    const QCommandLineOption toleranceOption("tolerance", "Settling band around the final flow, L/min.", "lpm", "0.3");
+    const QCommandLineOption gapOption("session-gap", "Idle time that starts a new session, s.", "seconds", "60");
+    const QCommandLineOption outlierOption("outlier-k", "Outlier threshold: median + k * 1.4826 * MAD.", "k", "3");
+    parser.addOptions({csvOption, jsonOption, timelineOption, toleranceOption, gapOption, outlierOption});
+    parser.process(app);
+
+    const double tolerance = parser.value(toleranceOption).toDouble();
+    const int64_t sessionGapMs = int64_t(parser.value(gapOption).toDouble() * 1000);
+    const double outlierK = parser.value(outlierOption).toDouble();
+
+    QTextStream err(stderr);
+    const QStringList inputs = collectInputs(parser.positionalArguments());
+    if (inputs.isEmpty()) {
+        err << "no input files\n";
+        return 1;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    // 1. Отображение журналов в память и нарезка на куски по границам строк.
+    std::vector<FileResult> files(size_t(inputs.size()));
+    std::vector<std::unique_ptr<QFile>> mapped;
+    QVector<Chunk> chunks;
+    for (int f = 0; f < inputs.size(); ++f) {
+        FileResult &file = files[size_t(f)];
+        file.path = inputs[f];
+        file.archive = file.path.endsWith(QLatin1String(".vta"), Qt::CaseInsensitive);
+        if (file.archive)
+            continue;
+
+        auto handle = std::make_unique<QFile>(file.path);
+        if (!handle->open(QIODevice::ReadOnly)) {
+            file.ok = false;
+            continue;
+        }
+        file.bytes = handle->size();
+        if (file.bytes == 0)
+            continue;
+        const char *data = reinterpret_cast<const char *>(handle->map(0, file.bytes));
+        if (!data) {
+            file.ok = false;
+            continue;
+        }
+
+        const char *end = data + file.bytes;
+        const char *p = data;
+        while (p < end) {
+            const char *next = p + qMin<qint64>(CHUNK_BYTES, end - p);
+            if (next < end) {
+                const char *nl = static_cast<const char *>(std::memchr(next, '\n', size_t(end - next)));
+                next = nl ? nl + 1 : end;
+            }
+            chunks.append(Chunk{f, p, next, {}, 0});
+            p = next;
+        }
+        mapped.push_back(std::move(handle));
+    }
+
+    // 2. Параллельный разбор кусков журналов.
+    QtConcurrent::blockingMap(chunks, parseChunk);
+
+    // 3. Сборка событий по файлам (куски идут по порядку) и параллельное восстановление сессий.
+    for (Chunk &chunk: chunks) {
+        FileResult &file = files[size_t(chunk.file)];
+        file.lines += chunk.lines;
+        if (file.events.empty())
+            file.events = std::move(chunk.events);
+        else
+            file.events.insert(file.events.end(), chunk.events.begin(), chunk.events.end());
+        std::vector<Event>().swap(chunk.events);
+    }
+    mapped.clear();
+
+    QtConcurrent::blockingMap(files, [&](FileResult &file) {
+        if (file.archive) {
+            file.bytes = QFileInfo(file.path).size();
+            file.ok = archiveEvents(file.path, &file.events);
+            if (!file.ok)
+                return;
+        }
+        buildPhases(file, tolerance, sessionGapMs);
+    });
+
+    // 4. Сводка, выбросы и вывод.
+    QVector<PhaseRef> phases;
+    qint64 bytes = 0, lines = 0, sessions = 0;
+    QStringList failed;
+    QHash<QString, int> alarmCounts;
+    for (const FileResult &file: files) {
+        bytes += file.bytes;
+        lines += file.lines;
+        if (!file.ok)
+            failed.append(file.path);
+        if (!file.phases.isEmpty())
+            sessions += file.phases.last().session;
+        for (const Phase &ph: file.phases)
+            phases.append(PhaseRef{&file, &ph});
+        for (const Event &e: file.events)
+            if (e.kind == EventKind::Alarm)
+                ++alarmCounts[QString::fromLatin1(INSUF::alarmName(static_cast<unsigned char>(e.value)))];
+    }
+
+    if (parser.isSet(csvOption)) {
+        QFile csv(parser.value(csvOption));
+        if (!csv.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            err << "cannot write " << csv.fileName() << ": " << csv.errorString() << "\n";
+            return 1;
+        }
+        QTextStream out(&csv);
+        writeCsv(out, phases);
+    } else {
+        QTextStream out(stdout);
+        writeCsv(out, phases);
+    }
+
+    if (parser.isSet(timelineOption)) {
+        const QString dir = parser.value(timelineOption);
+        QDir().mkpath(dir);
+        QtConcurrent::blockingMap(files, [&](const FileResult &file) {
+            const int count = file.phases.isEmpty() ? 0 : file.phases.last().session;
+            for (int s = 1; s <= count; ++s)
+                writeTimeline(dir, int(&file - files.data()), file, s);
+        });
+    }
+
+    QVector<double> durations, settles, rtts, rttP95, pulses;
+    int complete = 0, unanswered = 0;
+    for (const PhaseRef &ref: phases) {
+        const Phase &ph = *ref.phase;
+        durations.append((ph.endMs - ph.startMs) / 1000.0);
+        pulses.append(ph.pulses);
+        if (!std::isnan(ph.settleS))
+            settles.append(ph.settleS);
+        rtts += ph.rttMs;
+        if (!ph.rttMs.isEmpty())
+            rttP95.append(p95Of(ph.rttMs));
+        complete += ph.complete;
+        unanswered += ph.unanswered;
+    }
+
+    QJsonArray outliers;
+    auto flag = [&](const char *metric, auto value) {
+        QVector<double> values;
+        for (const PhaseRef &ref: phases) {
+            const double v = value(*ref.phase);
+            if (!std::isnan(v))
+                values.append(v);
+        }
+        const Spread s = spread(values);
+        if (!(s.mad > 0))
+            return;
+        const double threshold = s.median + outlierK * 1.4826 * s.mad;
+        for (const PhaseRef &ref: phases) {
+            const double v = value(*ref.phase);
+            if (std::isnan(v) || v <= threshold)
+                continue;
+            QJsonObject o;
+            o["file"] = ref.file->path;
+            o["session"] = ref.phase->session;
+            o["phase"] = ref.phase->index;
+            o["start"] = timeText(ref.phase->startMs);
+            o["metric"] = QString::fromLatin1(metric);
+            o["value"] = v;
+            o["threshold"] = threshold;
+            outliers.append(o);
+        }
+    };
+    flag("duration_s", [](const Phase &ph) { return (ph.endMs - ph.startMs) / 1000.0; });
+    flag("settle_s", [](const Phase &ph) { return ph.settleS; });
+    flag("pulses", [](const Phase &ph) { return double(ph.pulses); });
+    flag("rtt_p95_ms", [](const Phase &ph) { return ph.rttMs.isEmpty() ? NAN : p95Of(ph.rttMs); });
+
+    const double seconds = clock.elapsed() / 1000.0;
+    if (parser.isSet(jsonOption)) {
+        QJsonObject alarms;
+        for (auto it = alarmCounts.cbegin(); it != alarmCounts.cend(); ++it)
+            alarms[it.key()] = it.value();
+
+        QJsonObject root;
+        root["files"] = int(files.size());
+        root["failedFiles"] = QJsonArray::fromStringList(failed);
+        root["bytes"] = double(bytes);
+        root["lines"] = double(lines);
+        root["analysisSeconds"] = seconds;
+        root["sessions"] = double(sessions);
+        root["phases"] = phases.size();
+        root["completePhases"] = complete;
+        root["unansweredRequests"] = unanswered;
+        root["alarms"] = alarms;
+        root["phaseDurationSeconds"] = distribution(durations);
+        root["settleSeconds"] = distribution(settles);
+        root["pulsesPerPhase"] = distribution(pulses);
+        root["rttMs"] = distribution(rtts);
+        root["phaseRttP95Ms"] = distribution(rttP95);
+        root["outliers"] = outliers;
+
+        QFile json(parser.value(jsonOption));
+        if (!json.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "cannot write " << json.fileName() << ": " << json.errorString() << "\n";
+            return 1;
+        }
+        json.write(QJsonDocument(root).toJson());
+    }
+
+    err << files.size() << " files, " << lines << " lines, " << sessions << " sessions, "
+        << phases.size() << " phases, " << outliers.size() << " outliers in "
+        << QString::number(seconds, 'f', 2) << " s\n";
+    for (const QString &path: failed)
+        err << "failed: " << path << "\n";
+    return failed.isEmpty() ? 0 : 2;
+}